@@ -3,8 +3,6 @@
 #include <random>
 #include <omp.h>
 
-#include <boost/accumulators/statistics/weighted_extended_p_square.hpp>
-
 
 static double
 DrawRandomParameter(parameter_calibration &ParSetting, std::mt19937_64 &Generator)
@@ -22,18 +20,142 @@ DrawRandomParameter(parameter_calibration &ParSetting, std::mt19937_64 &Generato
 	return NewValue;
 }
 
-typedef boost::accumulators::accumulator_set<double, boost::accumulators::stats<boost::accumulators::tag::weighted_extended_p_square>, double> quantile_accumulator;
-
 
 #if !defined(GLUE_MULTITHREAD)
 #define GLUE_MULTITHREAD 1
 #endif
 
-static std::pair<double, double>
-ComputeWeightedPerformance(mobius_data_set *DataSet, double Performance, calibration_objective &Objective, std::vector<quantile_accumulator>& QuantileAccumulators, size_t DiscardTimesteps)
+#if !defined(GLUE_QUANTILE_SKETCH_COMPRESSION)
+#define GLUE_QUANTILE_SKETCH_COMPRESSION 100
+#endif
+
+
+//NOTE: A weighted quantile sketch (a merging t-digest). It keeps a bounded number of centroids (weighted means of nearby values), where the centroids are kept small near the tails so that extreme quantiles stay accurate. Two sketches can be merged, so each thread can keep its own sketches and they are merged at the end instead of every thread having to lock a shared accumulator. The number of centroids is about GLUE_QUANTILE_SKETCH_COMPRESSION, and is never more than the number of values that were added.
+struct quantile_sketch_centroid
 {
-	using namespace boost::accumulators;
+	double Mean;
+	double Weight;
+};
+
+struct quantile_sketch
+{
+	std::vector<quantile_sketch_centroid> Centroids;   //NOTE: Sorted by Mean after CompressQuantileSketch.
+	std::vector<quantile_sketch_centroid> Buffer;      //NOTE: Values that have been added, but not yet merged into the centroids.
+	double TotalWeight = 0.0;                          //NOTE: Of the centroids only.
+	double Min =  std::numeric_limits<double>::infinity();
+	double Max = -std::numeric_limits<double>::infinity();
+};
+
+inline double
+QuantileSketchScale(double Q)
+{
+	return ((double)GLUE_QUANTILE_SKETCH_COMPRESSION / (2.0*Pi)) * std::asin(2.0*Q - 1.0);
+}
+
+inline double
+QuantileSketchInverseScale(double K)
+{
+	return 0.5 * (std::sin(K * (2.0*Pi) / (double)GLUE_QUANTILE_SKETCH_COMPRESSION) + 1.0);
+}
+
+static void
+CompressQuantileSketch(quantile_sketch &Sketch)
+{
+	if(Sketch.Buffer.empty()) return;
+	
+	std::vector<quantile_sketch_centroid> &All = Sketch.Buffer;
+	All.insert(All.end(), Sketch.Centroids.begin(), Sketch.Centroids.end());
+	std::sort(All.begin(), All.end(), [](const quantile_sketch_centroid &A, const quantile_sketch_centroid &B) { return A.Mean < B.Mean; });
 	
+	double Total = 0.0;
+	for(const quantile_sketch_centroid &C : All) Total += C.Weight;
+	
+	Sketch.Centroids.clear();
+	
+	//NOTE: Merge neighbouring centroids as long as the merged one does not span more than one unit of the scale function.
+	quantile_sketch_centroid Current = All[0];
+	double WeightBefore = 0.0;
+	double QLimit = QuantileSketchInverseScale(QuantileSketchScale(0.0) + 1.0);
+	for(size_t Idx = 1; Idx < All.size(); ++Idx)
+	{
+		const quantile_sketch_centroid &Next = All[Idx];
+		double Q = (WeightBefore + Current.Weight + Next.Weight) / Total;
+		if(Q <= QLimit)
+		{
+			Current.Weight += Next.Weight;
+			Current.Mean   += (Next.Mean - Current.Mean) * Next.Weight / Current.Weight;
+		}
+		else
+		{
+			WeightBefore += Current.Weight;
+			Sketch.Centroids.push_back(Current);
+			QLimit = QuantileSketchInverseScale(QuantileSketchScale(WeightBefore / Total) + 1.0);
+			Current = Next;
+		}
+	}
+	Sketch.Centroids.push_back(Current);
+	
+	Sketch.TotalWeight = Total;
+	Sketch.Buffer.clear();
+}
+
+inline void
+AddToQuantileSketch(quantile_sketch &Sketch, double Value, double Weight)
+{
+	//NOTE: Values that are NaN or infinite can't be ordered, so they are left out.
+	if(!std::isfinite(Value) || !(Weight > 0.0)) return;
+	
+	Sketch.Buffer.push_back({Value, Weight});
+	Sketch.Min = std::min(Sketch.Min, Value);
+	Sketch.Max = std::max(Sketch.Max, Value);
+	
+	if(Sketch.Buffer.size() >= GLUE_QUANTILE_SKETCH_COMPRESSION) CompressQuantileSketch(Sketch);
+}
+
+static void
+MergeQuantileSketch(quantile_sketch &Sketch, const quantile_sketch &Other)
+{
+	Sketch.Buffer.insert(Sketch.Buffer.end(), Other.Centroids.begin(), Other.Centroids.end());
+	Sketch.Buffer.insert(Sketch.Buffer.end(), Other.Buffer.begin(), Other.Buffer.end());
+	Sketch.Min = std::min(Sketch.Min, Other.Min);
+	Sketch.Max = std::max(Sketch.Max, Other.Max);
+	CompressQuantileSketch(Sketch);
+}
+
+static double
+GetQuantileFromSketch(quantile_sketch &Sketch, double Quantile)
+{
+	CompressQuantileSketch(Sketch);
+	
+	const std::vector<quantile_sketch_centroid> &Centroids = Sketch.Centroids;
+	if(Centroids.empty()) return std::numeric_limits<double>::quiet_NaN();
+	if(Centroids.size() == 1) return Centroids[0].Mean;
+	
+	//NOTE: Interpolate linearly between the midpoints of the centroids in cumulative weight. The minimum is placed at cumulative weight 0 and the maximum at the total weight.
+	double Target = Quantile * Sketch.TotalWeight;
+	double PrevPos = 0.0;
+	double PrevVal = Sketch.Min;
+	double WeightBefore = 0.0;
+	for(const quantile_sketch_centroid &C : Centroids)
+	{
+		double Pos = WeightBefore + 0.5*C.Weight;
+		if(Target < Pos)
+		{
+			if(Pos <= PrevPos) return C.Mean;
+			return PrevVal + (C.Mean - PrevVal) * (Target - PrevPos) / (Pos - PrevPos);
+		}
+		PrevPos = Pos;
+		PrevVal = C.Mean;
+		WeightBefore += C.Weight;
+	}
+	double Pos = Sketch.TotalWeight;
+	if(Target >= Pos || Pos <= PrevPos) return Sketch.Max;
+	return PrevVal + (Sketch.Max - PrevVal) * (Target - PrevPos) / (Pos - PrevPos);
+}
+
+static std::pair<double, double>
+ComputeWeightedPerformance(mobius_data_set *DataSet, const calibration_binding &Binding, double Performance, calibration_objective &Objective, std::vector<quantile_sketch>& QuantileSketches, size_t DiscardTimesteps)
+{
 	double WeightedPerformance;
 	if(ShouldMaximize(Objective.PerformanceMeasure))
 	{
@@ -51,24 +173,44 @@ ComputeWeightedPerformance(mobius_data_set *DataSet, double Performance, calibra
 	
 	//TODO: The other EvaluateObjective we call before this already extracts this series, so it is kind of stupid to do it twice. Maybe we could make an optional version of it that gives us back the modeled series?
 	std::vector<double> ModeledSeries(Timesteps);
-	GetResultSeries(DataSet, Objective.ModeledName, Objective.ModeledIndexes, ModeledSeries.data(), ModeledSeries.size());
+	GetResultSeriesAtOffset(DataSet, Binding.ModeledOffset, ModeledSeries.data(), ModeledSeries.size());
 	
-	//TODO: It is probably not optimal to lock the entire for loop..
-#if GLUE_MULTITHREAD
-	#pragma omp critical
-	{
-#endif
+	//NOTE: The sketches belong to the calling thread only, so no locking is needed here.
 	//TODO! TODO! We should maybe also discard timesteps here too (but has to take care to do it correctly!)
+	if(QuantileSketches.size() < Timesteps) QuantileSketches.resize(Timesteps);
 	for(u64 Timestep = 0; Timestep < Timesteps; ++Timestep)
 	{
-		QuantileAccumulators[Timestep](ModeledSeries[Timestep], weight = StatWeight);
-	}
-#if GLUE_MULTITHREAD
+		AddToQuantileSketch(QuantileSketches[Timestep], ModeledSeries[Timestep], StatWeight);
 	}
-#endif
+	
 	return {Performance, WeightedPerformance};
 }
 
+static void
+EvaluateGLUERun(mobius_data_set *DataSet, const calibration_binding &Binding, glue_setup *Setup, glue_results *Results, size_t RunID, std::vector<quantile_sketch>& QuantileSketches)
+{
+	calibration_objective &Objective = Setup->Objectives[0];
+	
+	const double *ParValues = Results->RunData[RunID].RandomParameters.data();
+	
+	double RejectWorseThan = Setup->RejectNonBehavioural ? Objective.Threshold : std::numeric_limits<double>::quiet_NaN();
+	double Performance;
+	bool Rejected = EvaluateObjectiveOrReject(DataSet, Binding, Setup->Calibration, Objective, ParValues, Setup->DiscardTimesteps, RejectWorseThan, &Performance);
+	
+	std::pair<double, double> Perf;
+	if(Rejected)
+		Perf = {Performance, std::numeric_limits<double>::quiet_NaN()};
+	else
+		Perf = ComputeWeightedPerformance(DataSet, Binding, Performance, Objective, QuantileSketches, Setup->DiscardTimesteps);
+	
+	Results->RunData[RunID].PerformanceMeasures[0] = Perf;
+	Results->RunData[RunID].Rejected = Rejected;
+	
+#if CALIBRATION_PRINT_DEBUG_INFO
+	std::cout << "Performance and weighted performance for " << Objective.ModeledName << " vs " << Objective.ObservedName << " was " << std::endl << Perf.first << ", " << Perf.second << (Rejected ? " (rejected)" : "") << std::endl << std::endl;
+#endif
+}
+
 static void
 RunGLUE(mobius_data_set *DataSet, glue_setup *Setup, glue_results *Results)
 {
@@ -116,59 +258,61 @@ RunGLUE(mobius_data_set *DataSet, glue_setup *Setup, glue_results *Results)
 	
 	u64 NumTimesteps = GetTimesteps(DataSet);
 	
-	std::vector<quantile_accumulator> QuantileAccumulators;
-	QuantileAccumulators.reserve(NumTimesteps);
+	//NOTE: Look up the parameters, the modeled result and the observed series once. The binding is shared by all the runs, including the ones that work on copies of the data set.
+	calibration_binding Binding = BindCalibration(DataSet, Setup->Calibration, &Setup->Objectives[0]);
 	
-	for(size_t Timestep = 0; Timestep < NumTimesteps; ++Timestep)
-	{
-		QuantileAccumulators.push_back(quantile_accumulator(boost::accumulators::tag::weighted_extended_p_square::probabilities = Setup->Quantiles));
-	}
+	//NOTE: One set of quantile sketches (one per timestep) per thread. They are filled in without any locking and merged into the first set when all the runs are done.
+	std::vector<std::vector<quantile_sketch>> ThreadQuantileSketches;
 	
 #if GLUE_MULTITHREAD
 
 	omp_set_num_threads(Setup->NumThreads);
+	ThreadQuantileSketches.resize(omp_get_max_threads());
 
 	#pragma omp parallel for
 	for(size_t RunID = 0; RunID < Setup->NumRuns; ++RunID)
 	{
 		mobius_data_set *DataSet0 = CopyDataSet(DataSet); //NOTE: We have to work with a copy, otherwise the various threads will overwrite each other.
 		
-		calibration_objective &Objective = Setup->Objectives[0];
-			
-		const double *ParValues = Results->RunData[RunID].RandomParameters.data();
-		
-		double Performance = EvaluateObjective(DataSet0, Setup->Calibration, Objective, ParValues, Setup->DiscardTimesteps);
-
-		auto Perf = ComputeWeightedPerformance(DataSet0, Performance, Objective, QuantileAccumulators, Setup->DiscardTimesteps);
-
-		Results->RunData[RunID].PerformanceMeasures[0] = Perf;
+		EvaluateGLUERun(DataSet0, Binding, Setup, Results, RunID, ThreadQuantileSketches[omp_get_thread_num()]);
 		
 		delete DataSet0;
 	}
 	
 #else
 	
+	ThreadQuantileSketches.resize(1);
+	
 	for(size_t RunID = 0; RunID < Setup->NumRuns; ++RunID)
 	{
 #if CALIBRATION_PRINT_DEBUG_INFO
 		std::cout << "Run number: " << RunID << std::endl;
 #endif
-		calibration_objective &Objective = Setup->Objectives[0];
-
-		const double *ParValues = Results->RunData[RunID].RandomParameters.data();
-			
-		double Performance = EvaluateObjective(DataSet, Setup->Calibration, Objective, ParValues, Setup->DiscardTimesteps);
-
-		auto Perf = ComputeWeightedPerformance(DataSet, Performance, Objective, QuantileAccumulators, Setup->DiscardTimesteps);
-
-		Results->RunData[RunID].PerformanceMeasures[0] = Perf;
-
-#if CALIBRATION_PRINT_DEBUG_INFO		
-		std::cout << "Performance and weighted performance for " << Objective.ModeledName << " vs " << Objective.ObservedName << " was " << std::endl << Perf.first << ", " << Perf.second << std::endl << std::endl;
-#endif
+		EvaluateGLUERun(DataSet, Binding, Setup, Results, RunID, ThreadQuantileSketches[0]);
 	}
 #endif
 	
+	std::vector<quantile_sketch> &QuantileSketches = ThreadQuantileSketches[0];
+	QuantileSketches.resize(NumTimesteps);
+	
+	//NOTE: The timesteps are independent of each other, so they can be merged in parallel.
+#if GLUE_MULTITHREAD
+	#pragma omp parallel for
+#endif
+	for(s64 Timestep = 0; Timestep < (s64)NumTimesteps; ++Timestep)
+	{
+		for(size_t Thread = 1; Thread < ThreadQuantileSketches.size(); ++Thread)
+		{
+			if((size_t)Timestep < ThreadQuantileSketches[Thread].size())
+				MergeQuantileSketch(QuantileSketches[Timestep], ThreadQuantileSketches[Thread][Timestep]);
+		}
+	}
+	
+	size_t Rejected = 0;
+	for(glue_run_data &Run : Results->RunData) if(Run.Rejected) ++Rejected;
+	if(Rejected == Setup->NumRuns)
+		WarningPrint("WARNING: (GLUE) All the runs were rejected as non-behavioural, so the posterior distribution is empty.\n");
+	
 	Results->PostDistribution.resize(Setup->Quantiles.size());
 	
 	for(size_t QuantileIdx = 0; QuantileIdx < Setup->Quantiles.size(); ++QuantileIdx)
@@ -177,8 +321,7 @@ RunGLUE(mobius_data_set *DataSet, glue_setup *Setup, glue_results *Results)
 		
 		for(size_t Timestep = 0; Timestep < NumTimesteps; ++Timestep)
 		{
-			using namespace boost::accumulators;
-			Results->PostDistribution[QuantileIdx][Timestep] = weighted_extended_p_square(QuantileAccumulators[Timestep])[QuantileIdx];
+			Results->PostDistribution[QuantileIdx][Timestep] = GetQuantileFromSketch(QuantileSketches[Timestep], Setup->Quantiles[QuantileIdx]);
 		}
 	}
 }
\ No newline at end of file
@@ -17,12 +17,15 @@ struct glue_setup
 	std::vector<calibration_objective> Objectives;
 	
 	std::vector<double> Quantiles;
+	
+	bool RejectNonBehavioural = false;   //NOTE: If true, runs with a performance worse than the Threshold of the objective are left out of the distribution, and the model run is stopped as soon as that is certain (see EvaluateObjectiveOrReject). Otherwise all runs are weighted by their performance.
 };
 
 struct glue_run_data
 {
 	std::vector<double> RandomParameters;                         //NOTE: Values for parameters that we want to vary only.
 	std::vector<std::pair<double, double>> PerformanceMeasures;   //NOTE: One per objective.
+	bool Rejected = false;   //NOTE: If the run was not behavioural and RejectNonBehavioural was set. The performance is then only a bound if the run was stopped early, and the weighted performance is NaN.
 };
 
 struct glue_results
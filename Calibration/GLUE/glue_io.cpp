@@ -54,6 +54,10 @@ ReadGLUESetupFromFile(glue_setup *Setup, const char *Filename)
 		{
 			Stream.ReadDoubleSeries(Setup->Quantiles);
 		}
+		else if(Section.Equals("reject_non_behavioural"))
+		{
+			Setup->RejectNonBehavioural = Stream.ExpectBool();
+		}
 		else
 		{
 			Stream.PrintErrorHeader();
@@ -88,7 +92,7 @@ WriteGLUEResultsToDatabase(const char *Dbname, glue_setup *Setup, glue_results *
 	rc = sqlite3_finalize(CreateTableStmt);
 		
 	const char *CreateRunTable =
-		"CREATE TABLE Run (ID INTEGER NOT NULL PRIMARY KEY, Performance DOUBLE, WeightedPerformance DOUBLE);";
+		"CREATE TABLE Run (ID INTEGER NOT NULL PRIMARY KEY, Performance DOUBLE, WeightedPerformance DOUBLE, Rejected INTEGER);";
 	rc = sqlite3_prepare_v2(Db, CreateRunTable, -1, &CreateTableStmt, 0);
 	rc = sqlite3_step(CreateTableStmt);
 	rc = sqlite3_finalize(CreateTableStmt);
@@ -144,7 +148,7 @@ WriteGLUEResultsToDatabase(const char *Dbname, glue_setup *Setup, glue_results *
 	rc = sqlite3_finalize(InsertParameterInfoStmt);
 	
 	
-	const char *InsertRunInfo = "INSERT INTO Run (ID, Performance, WeightedPerformance) VALUES (?, ?, ?);";
+	const char *InsertRunInfo = "INSERT INTO Run (ID, Performance, WeightedPerformance, Rejected) VALUES (?, ?, ?, ?);";
 	
 	const char *InsertParameterSetInfo = "INSERT INTO ParameterSets (ParameterID, RunID, Value) VALUES (?, ?, ?);";
 	
@@ -154,6 +158,8 @@ WriteGLUEResultsToDatabase(const char *Dbname, glue_setup *Setup, glue_results *
 	sqlite3_stmt *InsertParameterSetInfoStmt;
 	rc = sqlite3_prepare_v2(Db, InsertParameterSetInfo, -1, &InsertParameterSetInfoStmt, 0);
 	
+	calibration_binding Binding = BindCalibration(DataSet, Setup->Calibration);
+	
 	for(size_t Run = 0; Run < Setup->NumRuns; ++Run)
 	{
 		int RunID = (int)Run + 1;
@@ -162,11 +168,12 @@ WriteGLUEResultsToDatabase(const char *Dbname, glue_setup *Setup, glue_results *
 		rc = sqlite3_bind_int(InsertRunInfoStmt, 1, RunID);
 		rc = sqlite3_bind_double(InsertRunInfoStmt, 2, Performance);
 		rc = sqlite3_bind_double(InsertRunInfoStmt, 3, WeightedPerformance);
+		rc = sqlite3_bind_int(InsertRunInfoStmt, 4, (int)Results->RunData[Run].Rejected);
 		
 		rc = sqlite3_step(InsertRunInfoStmt);
 		rc = sqlite3_reset(InsertRunInfoStmt);
 		
-		ApplyCalibrations(DataSet, Setup->Calibration, Results->RunData[Run].RandomParameters.data()); //NOTE: We just apply the calibration so that we can read the values from the dataset again without having to copy the code that assigns values to individual parameters here.
+		ApplyCalibrations(DataSet, Binding, Setup->Calibration, Results->RunData[Run].RandomParameters.data()); //NOTE: We just apply the calibration so that we can read the values from the dataset again without having to copy the code that assigns values to individual parameters here.
 		
 		int ParID = 0;
 		for(size_t CalIdx = 0; CalIdx < Setup->Calibration.size(); ++CalIdx)
@@ -174,7 +181,7 @@ WriteGLUEResultsToDatabase(const char *Dbname, glue_setup *Setup, glue_results *
 			parameter_calibration &Cal = Setup->Calibration[CalIdx];
 			for(size_t Par = 0; Par < Cal.ParameterNames.size(); ++Par)
 			{
-				double Value = GetParameterDouble(DataSet, Cal.ParameterNames[Par], Cal.ParameterIndexes[Par]);
+				double Value = DataSet->ParameterData[Binding.ParameterOffsets[CalIdx][Par]].ValDouble;
 				
 				rc = sqlite3_bind_int(InsertParameterSetInfoStmt, 1, ParID);
 				rc = sqlite3_bind_int(InsertParameterSetInfoStmt, 2, RunID);
@@ -56,6 +56,8 @@ struct mcmc_run_data
 	
 	calibration_objective Objective;
 	
+	calibration_binding Binding;    //NOTE: Shared by all the chains, since their data sets are copies of the same one.
+	
 	size_t DiscardTimesteps;
 };
 
@@ -171,7 +173,7 @@ TargetLogKernel(const arma::vec& Par, void* Data, size_t ChainIdx = 0)
 	
 	mobius_data_set *DataSet = RunData->DataSets[ChainIdx];
 	
-	double LogLikelyhood = EvaluateObjective(DataSet, RunData->Calibration, RunData->Objective, Par.memptr(), RunData->DiscardTimesteps);
+	double LogLikelyhood = EvaluateObjective(DataSet, RunData->Binding, RunData->Calibration, RunData->Objective, Par.memptr(), RunData->DiscardTimesteps);
 	
 	//TODO: When we have bounds turned on, it looks like de algorithm adds a log_jacobian for the priors. Find out what that is for!
 	double LogPriors = 0.0; //NOTE: This assumes uniformly distributed priors and that the MCMC driving algorithm discards draws outside the parameter min-max boundaries on its own.
@@ -193,12 +195,12 @@ TargetLogKernelWithGradient(const arma::vec &Par, arma::vec* GradientOut, void *
 	double LogLikelyhood;
 	if(GradientOut)
 	{
-		LogLikelyhood = EvaluateObjectiveAndGradientSingleForwardDifference(DataSet, RunData->Calibration, RunData->Objective, Par.memptr(), RunData->DiscardTimesteps, GradientOut->memptr());
+		LogLikelyhood = EvaluateObjectiveAndGradientSingleForwardDifference(DataSet, RunData->Binding, RunData->Calibration, RunData->Objective, Par.memptr(), RunData->DiscardTimesteps, GradientOut->memptr());
 		//GradCalls++;
 	}
 	else
 	{
-		LogLikelyhood = EvaluateObjective(DataSet, RunData->Calibration, RunData->Objective, Par.memptr(), RunData->DiscardTimesteps);
+		LogLikelyhood = EvaluateObjective(DataSet, RunData->Binding, RunData->Calibration, RunData->Objective, Par.memptr(), RunData->DiscardTimesteps);
 		//NonGradCalls++;
 	}
 	
@@ -341,6 +343,8 @@ static void RunMCMC(mobius_data_set *DataSet, mcmc_setup *Setup, mcmc_results *R
 	
 	RunData.DiscardTimesteps = Setup->DiscardTimesteps;
 	
+	RunData.Binding = BindCalibration(DataSet, RunData.Calibration, &RunData.Objective);
+	
 	u64 Timesteps = GetTimesteps(DataSet);
 	if(RunData.DiscardTimesteps >= Timesteps)
 	{
@@ -56,6 +56,7 @@ class optimization_model
 {
 	mobius_data_set *DataSet;
 	optimization_setup *Setup;
+	calibration_binding Binding;
 	
 public:
 	optimization_model(mobius_data_set *DataSet, optimization_setup *Setup)
@@ -67,6 +68,8 @@ public:
 		{
 			MOBIUS_FATAL_ERROR("ERROR: At the moment we only support having a single optimization objective." << std::endl);
 		}
+		
+		Binding = BindCalibration(DataSet, Setup->Calibration, &Setup->Objectives[0]);
 	}
 	
 	double operator()(const column_vector& Par)
@@ -74,7 +77,7 @@ public:
 		//TODO: Allow multiple objectives
 		calibration_objective &Objective = Setup->Objectives[0];
 		
-		double Performance = EvaluateObjective(DataSet, Setup->Calibration, Objective, Par.begin(), Setup->DiscardTimesteps);
+		double Performance = EvaluateObjective(DataSet, Binding, Setup->Calibration, Objective, Par.begin(), Setup->DiscardTimesteps);
 		
 		return ShouldMaximize(Objective.PerformanceMeasure) ? -Performance : Performance;
 	}
@@ -8,9 +8,6 @@
 
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
-#include <boost/accumulators/statistics/mean.hpp>
-#include <boost/accumulators/statistics/variance.hpp>
-#include <boost/accumulators/statistics/sum.hpp>
 
 
 
@@ -67,6 +64,19 @@ IsLogLikelyhoodMeasure(performance_measure_type Type)
 	return Type == PerformanceMeasure_LogLikelyhood_ProportionalNormal;
 }
 
+inline bool
+CanRejectEarly(performance_measure_type Type) //Whether a bound for the performance can be found before the model run is finished, see EvaluateObjectiveOrReject.
+{
+	return Type == PerformanceMeasure_MeanAbsoluteError || Type == PerformanceMeasure_MeanSquareError || Type == PerformanceMeasure_NashSutcliffe;
+}
+
+inline bool
+IsWorse(performance_measure_type Type, double Performance, double Than)
+{
+	if(ShouldMaximize(Type)) return Performance < Than;
+	return Performance > Than;
+}
+
 
 
 struct calibration_objective
@@ -295,46 +305,103 @@ GetDimensions(std::vector<parameter_calibration> &Calibrations)
 }
 
 
-static void
-ApplyCalibrations(mobius_data_set *DataSet, const char *Name, std::vector<const char *> &Indexes, double Value)
+//NOTE: The locations in the data set of everything a calibration touches, found once by BindCalibration so that ApplyCalibrations and EvaluateObjective don't have to look up parameters, results and inputs by name at every evaluation. A binding can be used with the data set it was made from and with any copy of it (see CopyDataSet) as long as the index sets are not changed, so several threads working on their own copies can share one binding.
+struct calibration_binding
 {
-	SetParameterValue(DataSet, Name, Indexes, Value);
+	const mobius_model *Model;
+	size_t ParameterCount;    //NOTE: The sizes of the parameter and result storage of the data set, used to check that the binding fits the data set it is used with.
+	size_t ResultCount;
+	
+	std::vector<std::vector<size_t>> ParameterOffsets;    //NOTE: For each parameter_calibration, the offset into ParameterData of each of its ParameterNames.
+	
+	bool HasObjective;
+	size_t ModeledOffset;     //NOTE: To be passed to GetResultSeriesAtOffset or AddStreamingObjective.
+	size_t ObservedOffset;    //NOTE: The location of the observed series within one timestep of InputData.
+};
+
+static calibration_binding
+BindCalibration(mobius_data_set *DataSet, std::vector<parameter_calibration> &Calibrations, calibration_objective *Objective = nullptr)
+{
+	calibration_binding Binding = {};
+	
+	Binding.ParameterOffsets.resize(Calibrations.size());
+	for(size_t CalIdx = 0; CalIdx < Calibrations.size(); ++CalIdx)
+	{
+		parameter_calibration &Cal = Calibrations[CalIdx];
+		for(size_t ParIdx = 0; ParIdx < Cal.ParameterNames.size(); ++ParIdx)
+		{
+			std::vector<const char *> &Indexes = Cal.ParameterIndexes[ParIdx];
+			size_t Offset = GetParameterOffset(DataSet, Cal.ParameterNames[ParIdx], Indexes.data(), Indexes.size(), ParameterType_Double);
+			Binding.ParameterOffsets[CalIdx].push_back(Offset);
+		}
+	}
+	
+	if(Objective)
+	{
+		Binding.HasObjective = true;
+		Binding.ModeledOffset = GetResultOffset(DataSet, Objective->ModeledName, Objective->ModeledIndexes.data(), Objective->ModeledIndexes.size());
+		Binding.ObservedOffset = GetInputOffset(DataSet, Objective->ObservedName, Objective->ObservedIndexes.data(), Objective->ObservedIndexes.size());
+	}
+	
+	Binding.Model          = DataSet->Model;
+	Binding.ParameterCount = DataSet->ParameterStorageStructure.TotalCount;
+	Binding.ResultCount    = DataSet->ResultStorageStructure.TotalCount;
+	
+	return Binding;
+}
+
+inline void
+CheckCalibrationBinding(mobius_data_set *DataSet, const calibration_binding &Binding, std::vector<parameter_calibration> &Calibrations)
+{
+	if(DataSet->Model != Binding.Model || !DataSet->ParameterData || DataSet->ParameterStorageStructure.TotalCount != Binding.ParameterCount || Binding.ParameterOffsets.size() != Calibrations.size())
+		FatalError("ERROR: (Calibration) Tried to use a calibration binding with a data set or a calibration it was not made for. Call BindCalibration again after changing the index sets of the data set.\n");
+}
+
+inline void
+ApplyCalibration(mobius_data_set *DataSet, parameter_calibration &Cal, size_t ParIdx, size_t Offset, double Value)
+{
+	DataSet->ParameterData[Offset].ValDouble = Value;
 #if CALIBRATION_PRINT_DEBUG_INFO
-	std::cout << "Setting \"" << Name << "\" {";
-	for(const char *Index : Indexes) std::cout << " \"" << Index << "\"";
+	std::cout << "Setting \"" << Cal.ParameterNames[ParIdx] << "\" {";
+	for(const char *Index : Cal.ParameterIndexes[ParIdx]) std::cout << " \"" << Index << "\"";
 	std::cout << " } to " << Value << std::endl;
 #endif
 }
 
 
 static void
-ApplyCalibrations(mobius_data_set *DataSet, std::vector<parameter_calibration> &Calibrations, const double *ParameterValues)
+ApplyCalibrations(mobius_data_set *DataSet, const calibration_binding &Binding, std::vector<parameter_calibration> &Calibrations, const double *ParameterValues)
 {
+	CheckCalibrationBinding(DataSet, Binding, Calibrations);
+	
 	size_t AtParValue = 0;
 	
-	for(parameter_calibration &Cal : Calibrations)
+	for(size_t CalIdx = 0; CalIdx < Calibrations.size(); ++CalIdx)
 	{
+		parameter_calibration &Cal = Calibrations[CalIdx];
+		const std::vector<size_t> &Offsets = Binding.ParameterOffsets[CalIdx];
+	
 		if(Cal.ParameterNames.size() == 1)
 		{
 			double Value = ParameterValues[AtParValue];
-			ApplyCalibrations(DataSet, Cal.ParameterNames[0], Cal.ParameterIndexes[0], Value);
+			ApplyCalibration(DataSet, Cal, 0, Offsets[0], Value);
 			++AtParValue;
-
+	
 		}
 		else if(Cal.LinkType == LinkType_Link)
 		{
 			double Value = ParameterValues[AtParValue];
 			++AtParValue;
-			
+	
 			for(size_t ParIdx = 0; ParIdx < Cal.ParameterNames.size(); ++ParIdx)
 			{
-				ApplyCalibrations(DataSet, Cal.ParameterNames[ParIdx], Cal.ParameterIndexes[ParIdx], Value);				
+				ApplyCalibration(DataSet, Cal, ParIdx, Offsets[ParIdx], Value);
 			}
 		}
 		else if(Cal.LinkType == LinkType_Partition)
 		{
 			size_t Dim = GetDimensions(Cal);
-
+	
 			std::vector<double> Values(Dim);
 			for(size_t Idx = 0; Idx < Dim; ++Idx)
 			{
@@ -342,33 +409,136 @@ ApplyCalibrations(mobius_data_set *DataSet, std::vector<parameter_calibration> &
 				Values[Idx] = Value;
 				++AtParValue;
 			}
-			
+	
 			std::sort(Values.begin(), Values.end());
 			Values.push_back(Cal.Max);
-			
-			ApplyCalibrations(DataSet, Cal.ParameterNames[0], Cal.ParameterIndexes[0], Values[0]);
-
+	
+			ApplyCalibration(DataSet, Cal, 0, Offsets[0], Values[0]);
+	
 			for(size_t ParIdx = 1; ParIdx < Cal.ParameterNames.size(); ++ParIdx)
 			{
 				double Value = Values[ParIdx] - Values[ParIdx - 1];
-				ApplyCalibrations(DataSet, Cal.ParameterNames[ParIdx], Cal.ParameterIndexes[ParIdx], Value);	
+				ApplyCalibration(DataSet, Cal, ParIdx, Offsets[ParIdx], Value);
 			}
 		}
 		else assert(0);
 	}
 }
 
+static void
+ApplyCalibrations(mobius_data_set *DataSet, std::vector<parameter_calibration> &Calibrations, const double *ParameterValues)
+{
+	//NOTE: If you apply calibrations many times, bind them once with BindCalibration and use the version of this function that takes the binding.
+	calibration_binding Binding = BindCalibration(DataSet, Calibrations);
+	ApplyCalibrations(DataSet, Binding, Calibrations, ParameterValues);
+}
+
 
+//NOTE: Compute a performance measure from the statistics that were accumulated during the last run of a data set (see AddStreamingObjective). M is the extra parameter of the log likelyhood measures, see EvaluateObjective.
 static double
-EvaluateObjective(mobius_data_set *DataSet, std::vector<parameter_calibration> &Calibrations, calibration_objective &Objective, const double *ParameterValues, size_t DiscardTimesteps = 0)
+ComputePerformance(const streaming_objective &Stats, performance_measure_type PerformanceMeasure, double M = 0.0)
+{
+	double Count = (double)Stats.Count;
+	double Performance;
+	
+	if(PerformanceMeasure == PerformanceMeasure_MeanAbsoluteError)
+	{
+		Performance = Stats.SumAbsResidual / Count;
+	}
+	else if(PerformanceMeasure == PerformanceMeasure_MeanSquareError)
+	{
+		Performance = Stats.SumSquaredResidual / Count;
+	}
+	else if(PerformanceMeasure == PerformanceMeasure_NashSutcliffe)
+	{
+		double MeanSquaresResidual = Stats.SumSquaredResidual / Count;
+		double ObservedVariance = Stats.SumSquaredDeviationObserved / Count;
+		
+		Performance = 1.0 - MeanSquaresResidual / ObservedVariance;
+	}
+	else if(PerformanceMeasure == PerformanceMeasure_LogLikelyhood_ProportionalNormal)
+	{
+		//NOTE: The sum over the timesteps of -0.5*log(2*Pi*Sigma^2) - Residual^2/(2*Sigma^2), where Sigma = M*Modeled.
+		//TODO: We should do something else upon NaN in the sim (return -inf?). NaN in obs just means that we don't have a value for that timestep, and so it is skipped.
+		Performance = -0.5*Count*std::log(2.0*Pi*M*M) - Stats.SumLogAbsModeled - 0.5*Stats.SumSquaredRelativeResidual / (M*M);
+	}
+	else assert(0);
+	
+	return Performance;
+}
+
+//NOTE: The number of observations that an objective can count during a run, and the sum of their squared deviations from their mean. The timesteps where the modeled value is NaN are not counted by the objective, so these are upper bounds for the Count and the SumSquaredDeviationObserved of the objective at the end of the run.
+static void
+GetObservedStatistics(mobius_data_set *DataSet, size_t ObservedOffset, size_t DiscardTimesteps, u64 *CountOut, double *SumSquaredDeviationOut)
+{
+	s64 InputTimestep = 0;
+	if(DataSet->InputDataHasSeparateStartDate)
+		InputTimestep = FindTimestep(DataSet->InputDataStartDate, GetStartDate(DataSet), DataSet->Model->TimestepSize);
+	u64 Timesteps = GetTimesteps(DataSet);
+	
+	u64 Count = 0;
+	double Mean = 0.0;
+	double SumSquaredDeviation = 0.0;
+	for(u64 Timestep = DiscardTimesteps; Timestep < Timesteps; ++Timestep)
+	{
+		s64 At = InputTimestep + (s64)Timestep;
+		if(At < 0 || At >= (s64)DataSet->InputDataTimesteps) continue;
+		
+		double Observed = DataSet->InputData[(size_t)At*DataSet->InputStorageStructure.TotalCount + ObservedOffset];
+		if(std::isnan(Observed)) continue;
+		
+		++Count;
+		double Deviation = Observed - Mean;
+		Mean += Deviation / (double)Count;
+		SumSquaredDeviation += Deviation*(Observed - Mean);
+	}
+	
+	*CountOut = Count;
+	*SumSquaredDeviationOut = SumSquaredDeviation;
+}
+
+//NOTE: Like EvaluateObjective, but the model run is stopped as soon as it is certain that the performance will be worse than RejectWorseThan. This saves a lot of time when most of the parameter sets are bad, e.g. in GLUE.
+//Returns true if the performance is worse than RejectWorseThan. If the run was stopped, PerformanceOut gets the best performance the run could still have had, which is already worse than RejectWorseThan.
+//The run can only be stopped early for the measures where CanRejectEarly is true, since the log likelyhood of the remaining timesteps can have any value. For the other measures the full run is always done. A RejectWorseThan of NaN never rejects.
+static bool
+EvaluateObjectiveOrReject(mobius_data_set *DataSet, const calibration_binding &Binding, std::vector<parameter_calibration> &Calibrations, calibration_objective &Objective, const double *ParameterValues, size_t DiscardTimesteps, double RejectWorseThan, double *PerformanceOut)
 {
 	//TODO: Evaluate multiple objectives?
 	
+	//NOTE: The objective is accumulated while the model runs, so this does not read the result series afterwards. The calibration can therefore run with a result window (see SetResultWindow), which saves a lot of memory for long series.
+	
 #if CALIBRATION_PRINT_DEBUG_INFO
 	std::cout << "Starting an objective evaluation" << std::endl;
 #endif
 	
-	ApplyCalibrations(DataSet, Calibrations, ParameterValues);
+	if(!Binding.HasObjective)
+		FatalError("ERROR: (Calibration) Tried to evaluate an objective with a calibration binding that was made without one.\n");
+	
+	ApplyCalibrations(DataSet, Binding, Calibrations, ParameterValues);
+	
+	size_t ObjectiveIdx = AddStreamingObjective(DataSet, Binding.ModeledOffset, Binding.ObservedOffset, DiscardTimesteps);
+	if(DataSet->ResultStorageStructure.TotalCount != Binding.ResultCount)
+		FatalError("ERROR: (Calibration) Tried to use a calibration binding with a data set it was not made for. Call BindCalibration again after changing the index sets of the data set.\n");
+	
+	performance_measure_type Measure = Objective.PerformanceMeasure;
+	
+	//NOTE: The sums of the residuals only grow during the run. The final performance can be bounded by the sums so far, using that there are at most ObservedCount timesteps to divide by, and that the variance of the observations that are counted is at most ObservedSumSquaredDeviation/ObservedCount.
+	double MaxSumAbsResidual     = std::numeric_limits<double>::infinity();
+	double MaxSumSquaredResidual = std::numeric_limits<double>::infinity();
+	u64 ObservedCount = 0;
+	double ObservedSumSquaredDeviation = 0.0;
+	if(CanRejectEarly(Measure) && !std::isnan(RejectWorseThan))
+	{
+		GetObservedStatistics(DataSet, Binding.ObservedOffset, DiscardTimesteps, &ObservedCount, &ObservedSumSquaredDeviation);
+		
+		if(Measure == PerformanceMeasure_MeanAbsoluteError)
+			MaxSumAbsResidual = RejectWorseThan * (double)ObservedCount;
+		else if(Measure == PerformanceMeasure_MeanSquareError)
+			MaxSumSquaredResidual = RejectWorseThan * (double)ObservedCount;
+		else if(Measure == PerformanceMeasure_NashSutcliffe)
+			MaxSumSquaredResidual = (1.0 - RejectWorseThan) * ObservedSumSquaredDeviation;
+	}
+	SetStreamingObjectiveLimits(DataSet, ObjectiveIdx, MaxSumAbsResidual, MaxSumSquaredResidual);
 
 #if CALIBRATION_PRINT_DEBUG_INFO
 	timer Timer = BeginTimer();
@@ -379,116 +549,82 @@ EvaluateObjective(mobius_data_set *DataSet, std::vector<parameter_calibration> &
 	RunModel(DataSet);
 #endif
 	
-	size_t Timesteps = (size_t)DataSet->TimestepsLastRun;
-	std::vector<double> ModeledSeries(Timesteps);
-	std::vector<double> ObservedSeries(Timesteps);
-	
-	GetResultSeries(DataSet, Objective.ModeledName, Objective.ModeledIndexes, ModeledSeries.data(), ModeledSeries.size());
-	GetInputSeries(DataSet, Objective.ObservedName, Objective.ObservedIndexes, ObservedSeries.data(), ObservedSeries.size(), true); //NOTE: It is a little wasteful reading a copy of this at every evaluation since it will be the same every time...
+	streaming_objective Stats = DataSet->StreamingObjectives[ObjectiveIdx];
 	
-	std::vector<double> Residuals(Timesteps);
+	//NOTE: Take the limits off again so that they don't stop later runs of the data set that are not evaluated by the calibration.
+	SetStreamingObjectiveLimits(DataSet, ObjectiveIdx, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity());
 	
-	for(size_t Timestep = DiscardTimesteps; Timestep < Timesteps; ++Timestep)
-	{
-		Residuals[Timestep] = ModeledSeries[Timestep] - ObservedSeries[Timestep];
-	}
+	if(DataSet->RunWasStopped && !Stats.Exceeded)
+		FatalError("ERROR: (Calibration) The model run was stopped by another streaming objective than the one of the calibration.\n");
 	
 	double Performance;
-	
-	using namespace boost::accumulators;
-	
-	if(Objective.PerformanceMeasure == PerformanceMeasure_MeanAbsoluteError)
+	if(Stats.Exceeded)
 	{
-		accumulator_set<double, features<tag::mean>> Accumulator;
-		
-		for(u64 Timestep = DiscardTimesteps; Timestep < Timesteps; ++Timestep)
-		{
-			if(!std::isnan(Residuals[Timestep]))
-				Accumulator(std::abs(Residuals[Timestep]));
-		}
-		
-		Performance = mean(Accumulator);
-	}
-	else if(Objective.PerformanceMeasure == PerformanceMeasure_MeanSquareError)
-	{
-		accumulator_set<double, features<tag::mean>> Accumulator;
-		
-		for(u64 Timestep = DiscardTimesteps; Timestep < Timesteps; ++Timestep)
-		{
-			double Res = Residuals[Timestep];
-			if(!std::isnan(Res))
-				Accumulator(Res*Res);
-		}
-		
-		Performance = mean(Accumulator);
+		if(Measure == PerformanceMeasure_MeanAbsoluteError)
+			Performance = Stats.SumAbsResidual / (double)ObservedCount;
+		else if(Measure == PerformanceMeasure_MeanSquareError)
+			Performance = Stats.SumSquaredResidual / (double)ObservedCount;
+		else
+			Performance = 1.0 - Stats.SumSquaredResidual / ObservedSumSquaredDeviation;
+#if CALIBRATION_PRINT_DEBUG_INFO
+		std::cout << "The run was stopped after " << DataSet->RunContext->RunState.Timestep << " timesteps since the performance could not get better than " << Performance << std::endl;
+#endif
 	}
-	else if(Objective.PerformanceMeasure == PerformanceMeasure_NashSutcliffe)
+	else
 	{
-		accumulator_set<double, features<tag::variance>> ObsAccum;
-		accumulator_set<double, features<tag::mean>> ResAccum;
-
-		for(u64 Timestep = DiscardTimesteps; Timestep < Timesteps; ++Timestep)
+		double M = 0.0;
+		if(IsLogLikelyhoodMeasure(Measure))
 		{
-			double Obs = ObservedSeries[Timestep];
-			double Res = Residuals[Timestep];
-			if(!std::isnan(Res))
-			{
-				ObsAccum(Obs);	
-				ResAccum(Res*Res);
-			}
-		}
-		
-		double MeanSquaresResidual = mean(ResAccum);
-		double ObservedVariance = variance(ObsAccum);
-		
-		Performance = 1.0 - MeanSquaresResidual / ObservedVariance;
-	}
-	else if(Objective.PerformanceMeasure == PerformanceMeasure_LogLikelyhood_ProportionalNormal)
-	{
-		size_t Dimensions = GetDimensions(Calibrations);
-		//NOTE: M is an extra parameter that is not a model parameter, so it is placed at the end of the ParameterValues vector. It is important that the caller of the function sets this up correctly..
-		double M = ParameterValues[Dimensions];
+			size_t Dimensions = GetDimensions(Calibrations);
+			//NOTE: M is an extra parameter that is not a model parameter, so it is placed at the end of the ParameterValues vector. It is important that the caller of the function sets this up correctly..
+			M = ParameterValues[Dimensions];
 #if CALIBRATION_PRINT_DEBUG_INFO
-		std::cout << "M was set to " << M << std::endl;
+			std::cout << "M was set to " << M << std::endl;
 #endif
-		
-		accumulator_set<double, stats<tag::sum>> LogLikelyhoodAccum;
-	
-		for(size_t Timestep = DiscardTimesteps; Timestep < Timesteps; ++Timestep)
-		{
-			double Sim = ModeledSeries[Timestep];
-			double Res = Residuals[Timestep];
-			if(!std::isnan(Res)) //TODO: We should do something else upon NaN in the sim (return -inf?). NaN in obs just means that we don't have a value for that timestep, and so we skip it.
-			{
-				double Sigma = M*Sim;
-				double Like = -0.5*std::log(2.0*Pi*Sigma*Sigma) - Res*Res / (2*Sigma*Sigma);
-				LogLikelyhoodAccum(Like);
-			}
 		}
 		
-		Performance = sum(LogLikelyhoodAccum);
+		Performance = ComputePerformance(Stats, Measure, M);
 	}
-	else assert(0);
 	
 #if CALIBRATION_PRINT_DEBUG_INFO
 	std::cout << "Performance: " << Performance << std::endl << std::endl;
 #endif
 	
+	*PerformanceOut = Performance;
+	return Stats.Exceeded || IsWorse(Measure, Performance, RejectWorseThan);
+}
+
+static double
+EvaluateObjective(mobius_data_set *DataSet, const calibration_binding &Binding, std::vector<parameter_calibration> &Calibrations, calibration_objective &Objective, const double *ParameterValues, size_t DiscardTimesteps = 0)
+{
+	double Performance;
+	EvaluateObjectiveOrReject(DataSet, Binding, Calibrations, Objective, ParameterValues, DiscardTimesteps, std::numeric_limits<double>::quiet_NaN(), &Performance);
 	return Performance;
 }
 
 
 static double
-EvaluateObjectiveAndGradientSingleForwardDifference(mobius_data_set *DataSet, std::vector<parameter_calibration> &Calibrations, calibration_objective &Objective, const double *ParameterValues, size_t DiscardTimesteps, double *GradientOut)
+EvaluateObjective(mobius_data_set *DataSet, std::vector<parameter_calibration> &Calibrations, calibration_objective &Objective, const double *ParameterValues, size_t DiscardTimesteps = 0)
+{
+	//NOTE: If you evaluate the objective many times, bind the calibration once with BindCalibration and use the version of this function that takes the binding.
+	calibration_binding Binding = BindCalibration(DataSet, Calibrations, &Objective);
+	return EvaluateObjective(DataSet, Binding, Calibrations, Objective, ParameterValues, DiscardTimesteps);
+}
+
+
+static double
+EvaluateObjectiveAndGradientSingleForwardDifference(mobius_data_set *DataSet, const calibration_binding &Binding, std::vector<parameter_calibration> &Calibrations, calibration_objective &Objective, const double *ParameterValues, size_t DiscardTimesteps, double *GradientOut)
 {	
 	
 	//NOTE: This is a very cheap and probably not that good estimation of the gradient. It should only be used if you need the estimation to be very fast (such as if you are going to use it for each step of an MCMC run).
 	size_t Dimensions = GetDimensions(Calibrations);    //IMPORTANT!! This is just for the particular LL function we have now. Should find a way to generalize this.
 	
-	double F0 = EvaluateObjective(DataSet, Calibrations, Objective, ParameterValues, DiscardTimesteps);
+	double F0 = EvaluateObjective(DataSet, Binding, Calibrations, Objective, ParameterValues, DiscardTimesteps);
 	
-	double *XD = (double *)malloc(sizeof(double) * Dimensions);
-	for(size_t Dim = 0; Dim < Dimensions; ++Dim) XD[Dim] = ParameterValues[Dim];
+	//NOTE: The log likelyhood measures read an extra parameter after the model parameters (see EvaluateObjective), so it has to be passed on too.
+	size_t ValueCount = IsLogLikelyhoodMeasure(Objective.PerformanceMeasure) ? Dimensions + 1 : Dimensions;
+	double *XD = (double *)malloc(sizeof(double) * ValueCount);
+	for(size_t Dim = 0; Dim < ValueCount; ++Dim) XD[Dim] = ParameterValues[Dim];
 	
 	const double Epsilon = 1e-6;
 	
@@ -509,7 +645,7 @@ EvaluateObjectiveAndGradientSingleForwardDifference(mobius_data_set *DataSet, st
 		
 		XD[Dim] += H;
 		
-		double FD = EvaluateObjective(DataSet, Calibrations, Objective, XD, DiscardTimesteps);
+		double FD = EvaluateObjective(DataSet, Binding, Calibrations, Objective, XD, DiscardTimesteps);
 		
 		double Grad = (FD - F0) / H;
 		//double Grad = (F0 - FD) / H;
@@ -530,5 +666,12 @@ EvaluateObjectiveAndGradientSingleForwardDifference(mobius_data_set *DataSet, st
 	return F0;
 }
 
+static double
+EvaluateObjectiveAndGradientSingleForwardDifference(mobius_data_set *DataSet, std::vector<parameter_calibration> &Calibrations, calibration_objective &Objective, const double *ParameterValues, size_t DiscardTimesteps, double *GradientOut)
+{
+	calibration_binding Binding = BindCalibration(DataSet, Calibrations, &Objective);
+	return EvaluateObjectiveAndGradientSingleForwardDifference(DataSet, Binding, Calibrations, Objective, ParameterValues, DiscardTimesteps, GradientOut);
+}
+
 #define CALIBRATION_H
 #endif
\ No newline at end of file
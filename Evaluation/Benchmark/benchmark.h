@@ -0,0 +1,167 @@
+#if !defined(MOBIUS_BENCHMARK_H)
+
+//NOTE: Benchmark harness for the shipped applications. Every benchmark_<model>.cpp in this folder builds one application against the parameter and input files that are bundled with it, and calls RunBenchmark. See run_benchmarks.sh (or run_benchmarks.bat) for how to build and run all of them.
+//
+//	benchmark_simplyq [repeats] [output file]
+//
+//The model is run once to warm up, then "repeats" times (default 20) for timing, and then once more with profiling on (see SetProfiling) to count equation evaluations and solver work. The profiled run is not part of the timings. The result is written as one line of JSON to the output file (appending to it), or to stdout if no output file is given, so that results from several models and several versions of the framework can be collected in one file and compared. The fields are:
+//
+//	"model"                        The name of the benchmark.
+//	"repeats"                      The number of timed runs.
+//	"timesteps"                    The number of timesteps in one run.
+//	"result_instances"             The number of result values that are stored per timestep.
+//	"definition_ns"                Time to build the model and do EndModelDefinition.
+//	"load_ns"                      Time to generate the data set and read the parameter and input files.
+//	"setup_ns_min"/"_median"       Time spent in BeginModelRun.
+//	"run_ns_min"/"_median"         Time spent running the timesteps and in EndModelRun.
+//	"ns_per_result_instance"       The median run time divided by timesteps*result_instances.
+//	"equation_evaluations"         The number of equation evaluations in one run, including the ones done by solvers.
+//	"solver_calls"                 The number of times a solver was called in one run, i.e. once per timestep per instance of a solver batch.
+//	"solver_evaluations"           The number of times a solver evaluated its system of ODEs in one run. This is the best measure of how many steps the solvers took.
+//	"peak_memory_kb"               The peak resident memory of the process.
+//	"solvers"                      Per solver: {"calls", "evaluations"}.
+//
+//The results are only comparable between runs on the same machine. Turn off other work on the machine while benchmarking, and compare medians rather than single runs.
+
+#define MOBIUS_TIMESTEP_VERBOSITY 0
+#define MOBIUS_TEST_FOR_NAN 0
+#define MOBIUS_EQUATION_PROFILING 0
+#define MOBIUS_PRINT_TIMING_INFO 0
+#define MOBIUS_INDEX_BOUNDS_TESTS 0
+
+#include "../../mobius.h"
+
+#ifdef _WIN32
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+#endif
+
+static u64
+GetPeakMemoryKilobytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS Counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters))) return 0;
+	return (u64)Counters.PeakWorkingSetSize / 1024;
+#else
+	struct rusage Usage;
+	if(getrusage(RUSAGE_SELF, &Usage) != 0) return 0;
+	#if defined(__APPLE__)
+	return (u64)Usage.ru_maxrss / 1024;    //NOTE: In bytes on macOS, in kilobytes on Linux.
+	#else
+	return (u64)Usage.ru_maxrss;
+	#endif
+#endif
+}
+
+static u64
+Median(std::vector<u64> Values)
+{
+	std::sort(Values.begin(), Values.end());
+	size_t Count = Values.size();
+	if(Count % 2 == 1) return Values[Count / 2];
+	return (Values[Count / 2 - 1] + Values[Count / 2]) / 2;
+}
+
+static int
+RunBenchmark(const char *Name, mobius_model *(*BuildModel)(), const char *ParameterFile, const char *InputFile, int argc, char **argv)
+{
+	int Repeats = 20;
+	if(argc > 1) Repeats = atoi(argv[1]);
+	if(Repeats < 1)
+		FatalError("ERROR: The number of repeats has to be at least 1.\n");
+	const char *OutputFile = argc > 2 ? argv[2] : nullptr;
+	
+	timer DefinitionTimer = BeginTimer();
+	mobius_model *Model = BuildModel();
+	ReadInputDependenciesFromFile(Model, InputFile);
+	EndModelDefinition(Model);
+	u64 DefinitionNs = GetTimerNanoseconds(&DefinitionTimer);
+	
+	timer LoadTimer = BeginTimer();
+	mobius_data_set *DataSet = GenerateDataSet(Model);
+	ReadParametersFromFile(DataSet, ParameterFile);
+	ReadInputsFromFile(DataSet, InputFile);
+	u64 LoadNs = GetTimerNanoseconds(&LoadTimer);
+	
+	RunModel(DataSet);    //NOTE: Warm-up, so that the first timed run does not pay for allocating the result storage and for cold caches.
+	
+	std::vector<u64> SetupNs(Repeats);
+	std::vector<u64> RunNs(Repeats);
+	for(int Repeat = 0; Repeat < Repeats; ++Repeat)
+	{
+		timer SetupTimer = BeginTimer();
+		BeginModelRun(DataSet);
+		SetupNs[Repeat] = GetTimerNanoseconds(&SetupTimer);
+		
+		timer RunTimer = BeginTimer();
+		u64 Timesteps = DataSet->TimestepsLastRun;
+		for(u64 Timestep = (u64)DataSet->RunContext->RunState.Timestep; Timestep < Timesteps; ++Timestep)
+			RunModelTimestep(DataSet);
+		EndModelRun(DataSet);
+		RunNs[Repeat] = GetTimerNanoseconds(&RunTimer);
+	}
+	
+	SetProfiling(DataSet, true);
+	RunModel(DataSet);
+	SetProfiling(DataSet, false);
+	
+	const run_profile &Profile = DataSet->Profile;
+	u64 EquationEvaluations = 0;
+	for(u64 Hits : Profile.EquationHits) EquationEvaluations += Hits;
+	u64 SolverCalls = 0;
+	u64 SolverEvaluations = 0;
+	for(solver_h Solver : Model->Solvers)
+	{
+		SolverCalls       += Profile.SolverHits[Solver.Handle];
+		SolverEvaluations += Profile.SolverEvaluations[Solver.Handle];
+	}
+	
+	u64 Timesteps       = DataSet->TimestepsLastRun;
+	u64 ResultInstances = DataSet->ResultStorageStructure.TotalCount;
+	u64 RunMedian       = Median(RunNs);
+	double NsPerResultInstance = (Timesteps*ResultInstances > 0) ? (double)RunMedian / (double)(Timesteps*ResultInstances) : 0.0;
+	
+	std::stringstream Json;
+	Json << "{\"model\": \"" << Name << "\""
+		<< ", \"repeats\": " << Repeats
+		<< ", \"timesteps\": " << Timesteps
+		<< ", \"result_instances\": " << ResultInstances
+		<< ", \"definition_ns\": " << DefinitionNs
+		<< ", \"load_ns\": " << LoadNs
+		<< ", \"setup_ns_min\": " << *std::min_element(SetupNs.begin(), SetupNs.end())
+		<< ", \"setup_ns_median\": " << Median(SetupNs)
+		<< ", \"run_ns_min\": " << *std::min_element(RunNs.begin(), RunNs.end())
+		<< ", \"run_ns_median\": " << RunMedian
+		<< ", \"ns_per_result_instance\": " << std::fixed << std::setprecision(3) << NsPerResultInstance
+		<< ", \"equation_evaluations\": " << EquationEvaluations
+		<< ", \"solver_calls\": " << SolverCalls
+		<< ", \"solver_evaluations\": " << SolverEvaluations
+		<< ", \"peak_memory_kb\": " << GetPeakMemoryKilobytes()
+		<< ", \"solvers\": {";
+	bool First = true;
+	for(solver_h Solver : Model->Solvers)
+	{
+		if(!First) Json << ", ";
+		First = false;
+		Json << "\"" << GetName(Model, Solver) << "\": {\"calls\": " << Profile.SolverHits[Solver.Handle] << ", \"evaluations\": " << Profile.SolverEvaluations[Solver.Handle] << "}";
+	}
+	Json << "}}";
+	
+	if(OutputFile)
+	{
+		FILE *File = fopen(OutputFile, "a");
+		if(!File)
+			FatalError("ERROR: Tried to open file \"", OutputFile, "\", but was not able to.\n");
+		fprintf(File, "%s\n", Json.str().c_str());
+		fclose(File);
+	}
+	else
+		std::cout << Json.str() << std::endl;
+	
+	return 0;
+}
+
+#define MOBIUS_BENCHMARK_H
+#endif
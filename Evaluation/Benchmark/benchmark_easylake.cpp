@@ -0,0 +1,23 @@
+#include "benchmark.h"
+
+#include "../../Modules/Persist.h"
+
+//NOTE: The bundled Langtjern inputs are set up for Easy-Lake coupled to PERSiST (they include met_persist.dat), so that is the version that is benchmarked.
+#define EASYLAKE_PERSIST
+#include "../../Modules/EasyLake.h"
+
+static mobius_model *
+BuildModel()
+{
+	mobius_model *Model = BeginModelDefinition("PERSiST with Easy-Lake");
+	
+	AddPersistModel(Model);
+	AddEasyLakePhysicalModule(Model);
+	
+	return Model;
+}
+
+int main(int argc, char **argv)
+{
+	return RunBenchmark("EasyLake", BuildModel, "../../Applications/EasyLake/testparameters_persist.dat", "../../Applications/EasyLake/langtjerninputs.dat", argc, argv);
+}
@@ -0,0 +1,18 @@
+#include "benchmark.h"
+
+#include "../../Modules/HBV.h"
+
+static mobius_model *
+BuildModel()
+{
+	mobius_model *Model = BeginModelDefinition("HBV");
+	
+	AddHBVModel(Model);
+	
+	return Model;
+}
+
+int main(int argc, char **argv)
+{
+	return RunBenchmark("HBV", BuildModel, "../../Applications/HBV/langtjernparameters.dat", "../../Applications/HBV/langtjerninputs.dat", argc, argv);
+}
@@ -0,0 +1,24 @@
+#include "benchmark.h"
+
+#include "../../Modules/Old/Persist_0_3.h"
+#include "../../Modules/SoilTemperature.h"
+#include "../../Modules/WaterTemperature.h"
+#include "../../Modules/INCA-N.h"
+
+static mobius_model *
+BuildModel()
+{
+	mobius_model *Model = BeginModelDefinition("INCA-N");
+	
+	AddPersistModel(Model);
+	AddSoilTemperatureModel(Model);
+	AddWaterTemperatureModel(Model);
+	AddIncaNModel(Model);
+	
+	return Model;
+}
+
+int main(int argc, char **argv)
+{
+	return RunBenchmark("INCA-N", BuildModel, "../../Applications/IncaN/Tarland/INCA-N_params_Tarland.dat", "../../Applications/IncaN/Tarland/INCA-N_inputs_Tarland.dat", argc, argv);
+}
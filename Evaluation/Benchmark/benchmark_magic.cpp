@@ -0,0 +1,22 @@
+#include "benchmark.h"
+
+#include "../../Modules/MAGIC/MAGIC_Core_wrapper.h"
+#include "../../Modules/MAGIC/MAGICBasic.h"
+#include "../../Modules/MAGIC/MAGIC_CarbonNitrogen.h"
+
+static mobius_model *
+BuildModel()
+{
+	mobius_model *Model = BeginModelDefinition("MAGIC", false, "1M");
+	
+	AddMagicCoreModel(Model);
+	AddMagicModel(Model);
+	AddMicrobialMagicCarbonNitrogenModel(Model);
+	
+	return Model;
+}
+
+int main(int argc, char **argv)
+{
+	return RunBenchmark("MAGIC", BuildModel, "../../Applications/MAGIC/testparameters_microbial.dat", "../../Applications/MAGIC/testinputs.dat", argc, argv);
+}
@@ -0,0 +1,18 @@
+#include "benchmark.h"
+
+#include "../../Modules/Persist.h"
+
+static mobius_model *
+BuildModel()
+{
+	mobius_model *Model = BeginModelDefinition("PERSiST");
+	
+	AddPersistModel(Model);
+	
+	return Model;
+}
+
+int main(int argc, char **argv)
+{
+	return RunBenchmark("PERSiST", BuildModel, "../../Applications/Persist/Tarland/persist_params_Tarland.dat", "../../Applications/Persist/Tarland/persist_inputs_Tarland.dat", argc, argv);
+}
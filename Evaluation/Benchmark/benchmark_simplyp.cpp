@@ -0,0 +1,21 @@
+#include "benchmark.h"
+
+#include "../../Modules/SimplyP.h"
+
+static mobius_model *
+BuildModel()
+{
+	mobius_model *Model = BeginModelDefinition("SimplyP");
+	
+	AddSimplyPHydrologyModule(Model);
+	AddSimplyPSedimentModule(Model);
+	AddSimplyPPhosphorusModule(Model);
+	AddSimplyPInputToWaterBodyModule(Model);
+	
+	return Model;
+}
+
+int main(int argc, char **argv)
+{
+	return RunBenchmark("SimplyP Tarland", BuildModel, "../../Applications/SimplyP/Tarland/TarlandParameters_v0-3_2ReachExample.dat", "../../Applications/SimplyP/Tarland/TarlandInputs.dat", argc, argv);
+}
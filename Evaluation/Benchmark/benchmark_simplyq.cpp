@@ -0,0 +1,22 @@
+#include "benchmark.h"
+
+#define SIMPLYQ_GROUNDWATER    //NOTE: #defining this before the inclusion of the SimplyQ.h file turns on groundwater in SimplyQ.
+
+#include "../../Modules/PET.h"
+#include "../../Modules/SimplyQ.h"
+
+static mobius_model *
+BuildModel()
+{
+	mobius_model *Model = BeginModelDefinition("SimplyQ");
+	
+	AddThornthwaitePETModule(Model);
+	AddSimplyHydrologyModule(Model);
+	
+	return Model;
+}
+
+int main(int argc, char **argv)
+{
+	return RunBenchmark("SimplyQ", BuildModel, "../../Applications/SimplyQ/testparameters.dat", "../../Applications/SimplyQ/tarlandinputs.dat", argc, argv);
+}
@@ -0,0 +1,18 @@
+@echo off
+REM Builds and runs the benchmarks of all the shipped applications.
+REM Usage: run_benchmarks.bat [repeats] [output file]
+REM The results are appended to the output file (default benchmark_results.jsonl), one line of JSON per model. See benchmark.h for the fields.
+
+set REPEATS=%1
+if "%REPEATS%"=="" set REPEATS=20
+set OUTPUT=%2
+if "%OUTPUT%"=="" set OUTPUT=benchmark_results.jsonl
+
+REM Most of the application build scripts use -fno-exceptions, so check that the framework still compiles without exceptions, both with and without OpenMP.
+g++ -m64 -std=c++11 -fno-exceptions -fsyntax-only -fmax-errors=5 benchmark_simplyq.cpp || exit /b 1
+g++ -m64 -std=c++11 -fno-exceptions -fopenmp -fsyntax-only -fmax-errors=5 benchmark_simplyq.cpp || exit /b 1
+
+for %%M in (simplyq simplyp incan persist magic hbv easylake) do (
+	g++ -m64 -std=c++11 -O2 -fmax-errors=5 benchmark_%%M.cpp -o benchmark_%%M.exe -lpsapi || exit /b 1
+	benchmark_%%M.exe %REPEATS% %OUTPUT% || exit /b 1
+)
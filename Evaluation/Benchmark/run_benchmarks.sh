@@ -0,0 +1,15 @@
+#!/bin/bash
+# Builds and runs the benchmarks of all the shipped applications.
+# Usage: ./run_benchmarks.sh [repeats] [output file]
+# The results are appended to the output file (default benchmark_results.jsonl), one line of JSON per model. See benchmark.h for the fields.
+cd "$(dirname "$0")"
+REPEATS=${1:-20}
+OUTPUT=${2:-benchmark_results.jsonl}
+# Most of the application build scripts use -fno-exceptions, so check that the framework still compiles without exceptions, both with and without OpenMP.
+g++ -m64 -std=c++11 -fno-exceptions -fsyntax-only -fmax-errors=5 benchmark_simplyq.cpp || exit 1
+g++ -m64 -std=c++11 -fno-exceptions -fopenmp -fsyntax-only -fmax-errors=5 benchmark_simplyq.cpp || exit 1
+for MODEL in simplyq simplyp incan persist magic hbv easylake
+do
+	g++ -m64 -std=c++11 -O2 -fmax-errors=5 benchmark_$MODEL.cpp -o benchmark_$MODEL || exit 1
+	./benchmark_$MODEL $REPEATS $OUTPUT || exit 1
+done
@@ -74,7 +74,7 @@ This is a shrimp population model that can react to environmental stressors. It
 		
 		u64 badtype = PARAMETER(BadYearType);
 		
-		if(CURRENT_TIME().Year == 2020) return 1;
+		if(CURRENT_TIME().Year == 2020) return 1.0;
 		
 		if(badtype > 0 && Age == FIRST_INDEX(AgeClass))
 		{
@@ -38,6 +38,8 @@ def initialize(dllname) :
 
 	mobiusdll.DllRunModel.argtypes = [ctypes.c_void_p]
 
+	mobiusdll.DllRunModelsParallel.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_uint64, ctypes.c_int32]
+
 	mobiusdll.DllCopyDataSet.argtypes = [ctypes.c_void_p, ctypes.c_bool]
 	mobiusdll.DllCopyDataSet.restype  = ctypes.c_void_p
 
@@ -59,6 +61,50 @@ def initialize(dllname) :
 
 	mobiusdll.DllGetResultSeries.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p), ctypes.c_uint64, ctypes.POINTER(ctypes.c_double)]
 
+	mobiusdll.DllGetResultInstanceCount.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+	mobiusdll.DllGetResultInstanceCount.restype = ctypes.c_uint64
+	
+	mobiusdll.DllGetResultBlock.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ctypes.c_double)]
+	
+	mobiusdll.DllBuildResultColumns.argtypes = [ctypes.c_void_p]
+	
+	mobiusdll.DllSetResultWindow.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+	
+	mobiusdll.DllSetResultFile.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+	
+	mobiusdll.DllSetSinglePrecisionResults.argtypes = [ctypes.c_void_p, ctypes.c_bool]
+	
+	mobiusdll.DllSetIncrementalRuns.argtypes = [ctypes.c_void_p, ctypes.c_bool]
+	mobiusdll.DllSetRandomSeed.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_uint64]
+	mobiusdll.DllClearRandomSeed.argtypes = [ctypes.c_void_p]
+	
+	mobiusdll.DllSaveCheckpoint.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int64, ctypes.c_uint64]
+	
+	mobiusdll.DllRestartFromCheckpoint.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+	
+	mobiusdll.DllClearRestartCheckpoint.argtypes = [ctypes.c_void_p]
+	
+	mobiusdll.DllSetProfiling.argtypes = [ctypes.c_void_p, ctypes.c_bool]
+	
+	mobiusdll.DllGetBatchGroupCount.argtypes = [ctypes.c_void_p]
+	mobiusdll.DllGetBatchGroupCount.restype  = ctypes.c_uint64
+	
+	mobiusdll.DllGetBatchGroupIndexSetsCount.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+	mobiusdll.DllGetBatchGroupIndexSetsCount.restype  = ctypes.c_uint64
+	
+	mobiusdll.DllGetBatchGroupIndexSets.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.POINTER(ctypes.c_char_p)]
+	
+	mobiusdll.DllGetAllSolversCount.argtypes = [ctypes.c_void_p]
+	mobiusdll.DllGetAllSolversCount.restype  = ctypes.c_uint64
+	
+	mobiusdll.DllGetAllSolvers.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_char_p)]
+	
+	mobiusdll.DllGetRunProfile.argtypes = [ctypes.c_void_p] + [ctypes.POINTER(ctypes.c_uint64)]*8
+	
+	mobiusdll.DllKeepResultSeries.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p), ctypes.c_uint64]
+	
+	mobiusdll.DllClearKeptResultSeries.argtypes = [ctypes.c_void_p]
+	
 	mobiusdll.DllGetInputSeries.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p), ctypes.c_uint64, ctypes.POINTER(ctypes.c_double), ctypes.c_bool]
 
 	mobiusdll.DllSetParameterDouble.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p), ctypes.c_uint64, ctypes.c_double]
@@ -173,6 +219,14 @@ def check_dll_error() :
 	if errcode == 1 :
 		errmsg = msgbuf.value.decode('utf-8')
 		raise RuntimeError(errmsg)
+
+def run_models_parallel(datasets, threads=0) :
+	'''
+	Runs several datasets of the same model at the same time, each on its own thread. Typically the datasets are copies of one dataset with different parameter or input values. The results are stored in each dataset just as if run_model had been called on it. If threads is 0, one thread is used per processor core. The dll has to be compiled with -fopenmp for the runs to happen in parallel, otherwise they are done one after another. If any of the runs fails, the error of the first dataset in the list that failed is raised after all the runs are done.
+	'''
+	ptrs = (ctypes.c_void_p * len(datasets))(*[dataset.datasetptr for dataset in datasets])
+	mobiusdll.DllRunModelsParallel(ptrs, len(datasets), threads)
+	check_dll_error()
 	
 class DataSet :
 	def __init__(self, datasetptr):
@@ -262,7 +316,7 @@ class DataSet :
 	
 	def copy(self, copyresults=False) :
 		'''
-		Create a copy of the dataset that contains all the same parameter values and input series. Result series will not be copied.
+		Create a copy of the dataset that contains all the same parameter values and input series. Result series will not be copied. The input series are shared with the original dataset until one of them calls set_input_series, so copying is cheap.
 		'''
 		cp = DataSet(mobiusdll.DllCopyDataSet(self.datasetptr, copyresults))
 		check_dll_error()
@@ -289,6 +343,152 @@ class DataSet :
 		timestep = mobiusdll.DllGetTimestepSize(self.datasetptr)
 		return ('S' if timestep.type == 0 else 'M', timestep.magnitude)
 		
+	def keep_result_series(self, name, indexes=[]) :
+		'''
+		Declare a result series as an output of the following model runs. Once any outputs are declared, only these have their full series stored, and the other results only keep their latest values (see set_result_window). This saves memory and time for large models.
+		
+		Arguments:
+			name             -- string. The name of the result series. Example : "Soil moisture"
+			indexes          -- list of strings. If given, only keep the series for this one combination of indexes. If empty, keep the series for all of them.
+		'''
+		mobiusdll.DllKeepResultSeries(self.datasetptr, _CStr(name), _PackIndexes(indexes), len(indexes))
+		check_dll_error()
+		
+	def clear_kept_result_series(self) :
+		'''
+		Go back to storing the full series of every result in the following model runs.
+		'''
+		mobiusdll.DllClearKeptResultSeries(self.datasetptr)
+		check_dll_error()
+		
+	def set_result_window(self, window) :
+		'''
+		Only keep the latest 'window' timesteps of the results that were not declared with keep_result_series. The window has to be larger than the longest lookback of any EARLIER_RESULT in the model. Lookbacks that depend on a parameter value are found during the first run, which is then done again with every timestep kept. 0 means that all timesteps are kept (unless keep_result_series was used).
+		'''
+		mobiusdll.DllSetResultWindow(self.datasetptr, window)
+		check_dll_error()
+	
+	def set_result_file(self, filename) :
+		'''
+		Store the results of the following model runs in a memory mapped file instead of in memory. The results stay in the file after the program exits, and can be read with ResultFile. Give an empty filename to go back to storing the results in memory.
+		'''
+		mobiusdll.DllSetResultFile(self.datasetptr, _CStr(filename))
+		check_dll_error()
+	
+	def set_single_precision_results(self, single_precision) :
+		'''
+		Store the result history of the following model runs as 32-bit floats instead of 64-bit doubles. This halves the memory used for the results. get_result_series still returns 64-bit values. The model state used during the run is still kept in double precision.
+		'''
+		mobiusdll.DllSetSinglePrecisionResults(self.datasetptr, single_precision)
+		check_dll_error()
+	
+	def set_incremental_runs(self, incremental) :
+		'''
+		Let the following model runs only compute the timesteps from the first one where an input value changed since the last run, and keep the results before that. This only has an effect if the parameters, the start date and the number of timesteps are the same as in the last run, and the full result series are kept. The dataset keeps a copy of the inputs to find what changed.
+		'''
+		mobiusdll.DllSetIncrementalRuns(self.datasetptr, incremental)
+		check_dll_error()
+	
+	def set_random_seed(self, seed, stream=0) :
+		'''
+		Make the random numbers drawn by the equations of the model in the following runs determined by the seed, so that the runs can be reproduced. Runs with the same seed and stream get the same random numbers. Give datasets different streams if they should draw independently of each other, e.g. the members of a stochastic ensemble. Copies of the dataset get the same seed and stream.
+		'''
+		mobiusdll.DllSetRandomSeed(self.datasetptr, seed, stream)
+		check_dll_error()
+	
+	def clear_random_seed(self) :
+		'''
+		Let every following run draw a new random seed, as is the default.
+		'''
+		mobiusdll.DllClearRandomSeed(self.datasetptr)
+		check_dll_error()
+	
+	def save_checkpoint(self, filename, timestep=-1, history_timesteps=0) :
+		'''
+		Save the state of the last model run at the start of the given timestep to a checkpoint file, so that later runs can be restarted from it with restart_from_checkpoint. The default is the end of the last run.
+		
+		Arguments:
+			filename          -- string. The file to write the checkpoint to.
+			timestep          -- int. The number of timesteps of the last run that the state is taken after. -1 means the end of the run.
+			history_timesteps -- int. How many timesteps of results before the state to also store. This is needed for models that look back at earlier results.
+		'''
+		mobiusdll.DllSaveCheckpoint(self.datasetptr, _CStr(filename), timestep, history_timesteps)
+		check_dll_error()
+	
+	def restart_from_checkpoint(self, filename) :
+		'''
+		Let the following model runs start from the state in a checkpoint file written by save_checkpoint instead of from the initial values. This also sets the "Start date" parameter to the date of the checkpoint.
+		'''
+		mobiusdll.DllRestartFromCheckpoint(self.datasetptr, _CStr(filename))
+		check_dll_error()
+	
+	def clear_restart_checkpoint(self) :
+		'''
+		Let the following model runs start from the initial values again.
+		'''
+		mobiusdll.DllClearRestartCheckpoint(self.datasetptr)
+		check_dll_error()
+	
+	def set_profiling(self, profiling) :
+		'''
+		Collect timing information about the following model runs, which can be read with get_run_profile. This makes the model run a little slower, so it should be turned off when the information is not needed.
+		'''
+		mobiusdll.DllSetProfiling(self.datasetptr, profiling)
+		check_dll_error()
+	
+	def get_run_profile(self) :
+		'''
+		Get the timing information of the last model run that was done with profiling turned on (see set_profiling). Cycles are processor clock ticks. The cycles of a solver include the evaluations of the equations that are on it.
+		
+		Returns:
+			A dictionary with the keys
+			'setup_ms', 'run_ms', 'setup_cycles', 'run_cycles' -- int. The time spent setting up the run and computing the timesteps.
+			'timesteps'    -- int. The number of timesteps that were computed.
+			'equations'    -- dictionary from equation name to a pair (cycles, number of evaluations).
+			'batch_groups' -- list of triples (list of index set names, cycles, number of runs), in the order the batch groups are evaluated.
+			'solvers'      -- dictionary from solver name to a triple (cycles, number of calls, number of evaluations of the ODE system).
+		'''
+		equation_names = [name for name, type in self.get_equation_list()]
+		
+		groupcount = mobiusdll.DllGetBatchGroupCount(self.datasetptr)
+		check_dll_error()
+		groupindexsets = []
+		for group in range(groupcount) :
+			num = mobiusdll.DllGetBatchGroupIndexSetsCount(self.datasetptr, group)
+			check_dll_error()
+			namearray = (ctypes.c_char_p * num)()
+			mobiusdll.DllGetBatchGroupIndexSets(self.datasetptr, group, namearray)
+			check_dll_error()
+			groupindexsets.append([name.decode('utf-8') for name in namearray])
+		
+		solvercount = mobiusdll.DllGetAllSolversCount(self.datasetptr)
+		check_dll_error()
+		solverarray = (ctypes.c_char_p * solvercount)()
+		mobiusdll.DllGetAllSolvers(self.datasetptr, solverarray)
+		check_dll_error()
+		
+		times        = (ctypes.c_uint64 * 5)()
+		eqcycles     = (ctypes.c_uint64 * len(equation_names))()
+		eqhits       = (ctypes.c_uint64 * len(equation_names))()
+		groupcycles  = (ctypes.c_uint64 * groupcount)()
+		grouphits    = (ctypes.c_uint64 * groupcount)()
+		solvercycles = (ctypes.c_uint64 * solvercount)()
+		solverhits   = (ctypes.c_uint64 * solvercount)()
+		solverevals  = (ctypes.c_uint64 * solvercount)()
+		mobiusdll.DllGetRunProfile(self.datasetptr, times, eqcycles, eqhits, groupcycles, grouphits, solvercycles, solverhits, solverevals)
+		check_dll_error()
+		
+		return {
+			'setup_ms'     : times[0],
+			'run_ms'       : times[1],
+			'setup_cycles' : times[2],
+			'run_cycles'   : times[3],
+			'timesteps'    : times[4],
+			'equations'    : {name : (eqcycles[idx], eqhits[idx]) for idx, name in enumerate(equation_names)},
+			'batch_groups' : [(groupindexsets[idx], groupcycles[idx], grouphits[idx]) for idx in range(groupcount)],
+			'solvers'      : {solverarray[idx].decode('utf-8') : (solvercycles[idx], solverhits[idx], solverevals[idx]) for idx in range(solvercount)},
+		}
+	
 	def get_result_series(self, name, indexes) :
 		'''
 		Extract one of the result series that was produced by the model. Can only be called after dataset.run_model() has been called at least once.
@@ -310,6 +510,36 @@ class DataSet :
 	
 		return np.array(resultseries, copy=False)
 		
+	def get_result_block(self, name) :
+		'''
+		Extract the result series of every instance of a result in one go. This is much faster than calling get_result_series for each instance. Can only be called after dataset.run_model() has been called at least once.
+		
+		Arguments:
+			name             -- string. The name of the result series. Example : "Soil moisture"
+		
+		Returns:
+			A 2-dimensional numpy.array with one row per instance and one column per timestep. The instances are ordered with the index of the last index set of get_result_index_sets(name) changing fastest.
+		'''
+		timesteps = mobiusdll.DllGetTimesteps(self.datasetptr)
+		check_dll_error()
+		
+		instances = mobiusdll.DllGetResultInstanceCount(self.datasetptr, _CStr(name))
+		check_dll_error()
+		
+		block = (ctypes.c_double * (instances * timesteps))()
+		
+		mobiusdll.DllGetResultBlock(self.datasetptr, _CStr(name), block)
+		check_dll_error()
+		
+		return np.array(block, copy=False).reshape((instances, timesteps))
+		
+	def build_result_columns(self) :
+		'''
+		Store a column major copy of the results of the last run, which makes the following calls to get_result_series and get_result_block faster. Useful before extracting many result series. The copy takes as much memory as the results, and is discarded when the model is run again.
+		'''
+		mobiusdll.DllBuildResultColumns(self.datasetptr)
+		check_dll_error()
+		
 	def get_input_series(self, name, indexes, alignwithresults=False) :
 		'''
 		Extract one of the input series that were provided with the dataset.
@@ -694,11 +924,11 @@ class DataSet :
 		'''
 		Get the name and type of all the equations in the model as a list of pairs of strings.
 		'''
-		num = mobiusdll.DllGetAllResultsCount(self.datasetptr, '__all!!__')
+		num = mobiusdll.DllGetAllResultsCount(self.datasetptr, _CStr('__all!!__'))
 		check_dll_error()
 		namearray = (ctypes.c_char_p * num)()
 		typearray = (ctypes.c_char_p * num)()
-		mobiusdll.DllGetAllResults(self.datasetptr, namearray, typearray, '__all!!__')
+		mobiusdll.DllGetAllResults(self.datasetptr, namearray, typearray, _CStr('__all!!__'))
 		check_dll_error()
 		return [(name.decode('utf-8'), type.decode('utf-8')) for name, type in zip(namearray, typearray)]
 		
@@ -746,4 +976,65 @@ class DataSet :
 		mobiusdll.DllGetBranchInputs(self.datasetptr, _CStr(indexsetname), _CStr(indexname), namearray)
 		check_dll_error()
 		return [name.decode('utf-8') for name in namearray]
-		
\ No newline at end of file
+
+class ResultFile :
+	'''
+	Read access to a result file written by a model run after DataSet.set_result_file. The results are mapped into memory, so only the parts that are used are read from disk. This does not need the model dll. See mobius_result_file.h for the file format.
+	'''
+	def __init__(self, filename) :
+		header = np.fromfile(filename, dtype=np.uint64, count=8)
+		magic = header[0:1].tobytes()
+		if magic != b'MOBIUSRF' :
+			raise RuntimeError('The file %s is not a Mobius result file.' % filename)
+		version, valuesize = header[1:2].view(np.uint32)
+		if version != 1 or valuesize != 8 :
+			raise RuntimeError('Unsupported version of the result file %s.' % filename)
+		descoffset, descsize, dataoffset, self.timesteps, self.values_per_timestep = [int(x) for x in header[2:7]]
+		self.start_date = dt.datetime(1970, 1, 1) + dt.timedelta(seconds=int(header[7:8].view(np.int64)[0]))
+		
+		with open(filename, 'rb') as file :
+			file.seek(descoffset)
+			description = file.read(descsize).decode('utf-8')
+		
+		self.index_sets = {}
+		self.units = []
+		self._equations = {}
+		for line in description.split('\n') :
+			fields = line.split('\t')
+			if fields[0] == 'model' :
+				self.model_name = fields[1]
+			elif fields[0] == 'timestep' :
+				self.timestep_unit = fields[1]
+				self.timestep_magnitude = int(fields[2])
+			elif fields[0] == 'index_set' :
+				self.index_sets[fields[1]] = fields[2:]
+			elif fields[0] == 'unit' :
+				self.units.append((int(fields[1]), int(fields[2]), fields[3:]))
+				location = 0
+			elif fields[0] == 'equation' :
+				self._equations[fields[1]] = (self.units[-1][0] + location, len(self.units)-1)
+				location += 1
+		
+		self.data = np.memmap(filename, dtype=np.float64, mode='r', offset=dataoffset, shape=(self.timesteps+1, self.values_per_timestep))
+	
+	def get_result_series(self, name, indexes) :
+		'''
+		Get one of the result series that are stored in the file, not including the initial value.
+		
+		Arguments:
+			name             -- string. The name of the result series. Example : "Soil moisture"
+			indexes          -- list of strings. A list of index names to identify the particular result series. Example : ["Langtjern"] or ["Langtjern", "Forest"]
+		
+		Returns:
+			A numpy.array view of the series in the file.
+		'''
+		if name not in self._equations :
+			raise RuntimeError('The result file does not contain the result "%s".' % name)
+		offset, unitidx = self._equations[name]
+		_, equationcount, indexsets = self.units[unitidx]
+		if len(indexes) != len(indexsets) :
+			raise RuntimeError('Got the wrong amount of indexes for "%s". Got %d, expected %d.' % (name, len(indexes), len(indexsets)))
+		instance = 0
+		for indexset, index in zip(indexsets, indexes) :
+			instance = instance*len(self.index_sets[indexset]) + self.index_sets[indexset].index(index)
+		return self.data[1:, offset + instance*equationcount]
@@ -206,10 +206,10 @@ public:
 	inline char *
 	ToString()
 	{
-		//Important: note that this one is overwritten whenever you call it. So you should make a copy of the string if you want to keep it.
+		//Important: note that this one is overwritten whenever you call it (on the same thread). So you should make a copy of the string if you want to keep it.
 		s32 Year, Month, Day, Hour, Minute, Second;
 		YearMonthDay(&Year, &Month, &Day);
-		static char Buf[64];
+		static thread_local char Buf[64];
 		if(SecondsSinceEpoch % 86400 == 0)
 		{
 			sprintf(Buf, "%04d-%02d-%02d", Year, Month, Day);
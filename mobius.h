@@ -24,6 +24,31 @@
 #include <iomanip>
 #include <codecvt>
 #include <random>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <exception>
+
+//NOTE: RunModelsParallel uses OpenMP whenever the program is compiled with it (-fopenmp), MOBIUS_PARALLEL_INSTANCES requires it.
+#if defined(_OPENMP) || (defined(MOBIUS_PARALLEL_INSTANCES) && MOBIUS_PARALLEL_INSTANCES)
+#include <omp.h>
+#endif
+
+//NOTE: For memory mapped result files (mobius_result_file.h).
+#if defined(_WIN32)
+	#if !defined(WIN32_LEAN_AND_MEAN)
+	#define WIN32_LEAN_AND_MEAN
+	#endif
+	#if !defined(NOMINMAX)
+	#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
 
 
 //NOTE: we use the intrin header for __rdtsc(); The intrinsic is in different headers for different compilers. If you compile with a different compiler than what is already set up you have to add in some lines below.
@@ -58,10 +83,14 @@ ErrorPrint(t Value, v... Tail)
 	ErrorPrint(Tail...);
 }
 
+//NOTE: Several threads can run into errors at the same time when data sets are run with RunModelsParallel. Only the first one gets to print its message and exit, the others wait here until the process is gone.
+static std::mutex Mobius_FatalErrorMutex;
+
 template<typename... v>
 void
 FatalError(v... Tail)
 {
+	Mobius_FatalErrorMutex.lock(); //NOTE: Never unlocked, since we exit.
 	ErrorPrint(Tail...);
 	exit(1);
 }	
@@ -87,6 +116,8 @@ WarningPrint(t Value, v... Tail)
 #include "datetime.h"
 #include "mobius_model.h"
 #include "mobius_data_set.h"
+#include "mobius_result_file.h"
+#include "mobius_checkpoint.h"
 #include "jacobian.h"
 #include "mobius_model_run.h"
 #include "lexer.h"
@@ -0,0 +1,208 @@
+#if !defined(MOBIUS_CHECKPOINT_H)
+
+//NOTE: Checkpoints and restarts.
+//
+//The only state that is carried from one timestep of a model run to the next is the result values of the previous timestep (and, for equations that use EARLIER_RESULT, the results of timesteps further back) together with the current date. Parameters, computed parameters and solver work space are set up again at the start of every run. A checkpoint holds that state, so that a run can start at the checkpoint instead of computing the whole history again. This is useful for long spin-up periods that are shared by many scenarios.
+//
+//	RunModel(DataSet);                                        //NOTE: E.g. the spin-up period.
+//	model_checkpoint Checkpoint;
+//	SaveCheckpoint(DataSet, DataSet->TimestepsLastRun, &Checkpoint);
+//	...
+//	RestartFromCheckpoint(ScenarioDataSet, Checkpoint);       //NOTE: Sets the "Start date" of ScenarioDataSet to the date of the checkpoint.
+//	RunModel(ScenarioDataSet);
+//
+//A restarted run gives the same results as continuing the original run, as long as the parameters and inputs are the same, and the checkpoint keeps at least as many HistoryTimesteps as the longest EARLIER_RESULT lookback of the model. The results of a restarted run start at the checkpoint, and CURRENT_TIMESTEP() counts from 0 at the restart.
+//
+//Layout of a checkpoint file. All numbers are stored in the byte order of the machine that wrote the file.
+//
+//	checkpoint_file_header (64 bytes, see below).
+//	Structure: StructureSize bytes of UTF-8 text (same format as the description in a result file, see mobius_result_file.h).
+//	Results: (HistoryTimesteps + 1) rows of ValuesPerTimestep doubles, see model_checkpoint.
+
+struct checkpoint_file_header
+{
+	char Magic[8];              //NOTE: "MOBIUSCP"
+	u32  Version;               //NOTE: 1
+	u32  ValueSize;             //NOTE: sizeof(double)
+	s64  Date;                  //NOTE: model_checkpoint::Date as seconds since 1970-01-01 00:00:00.
+	u64  ValuesPerTimestep;
+	u64  HistoryTimesteps;
+	u64  StructureSize;
+	u64  Reserved[2];
+};
+
+static_assert(sizeof(checkpoint_file_header) == 64, "The size of the checkpoint file header is part of the file format and should not change.");
+
+//NOTE: Returns the row of ResultData that holds the results of the given timestep of the last run, or nullptr if it is no longer stored. Timestep -1 gives the initial values, and timesteps before that are taken from the checkpoint the data set restarts from, if any.
+static const double *
+GetResultRowLastRun(mobius_data_set *DataSet, s64 Timestep)
+{
+	size_t ValuesPerTimestep = DataSet->ResultStorageStructure.TotalCount;
+	
+	if(Timestep < -1)
+	{
+		const model_checkpoint &Restart = DataSet->Restart;
+		u64 Back = (u64)(-1 - Timestep);
+		if(Restart.Results.empty() || Back > Restart.HistoryTimesteps) return nullptr;
+		return Restart.Results.data() + Back*ValuesPerTimestep;
+	}
+	if(Timestep == -1) return DataSet->ResultData;
+	if((u64)Timestep >= DataSet->TimestepsLastRun) return nullptr;
+	
+	if(DataSet->ResultDataTimesteps < DataSet->TimestepsLastRun)
+	{
+		//NOTE: Only a window of the latest timesteps is kept, see SetResultWindow. The float history of SetSinglePrecisionResults is not used, since a checkpoint should be exact.
+		if((u64)Timestep < DataSet->TimestepsLastRun - DataSet->ResultDataTimesteps) return nullptr;
+		return DataSet->ResultData + (1 + (u64)Timestep % DataSet->ResultDataTimesteps)*ValuesPerTimestep;
+	}
+	return DataSet->ResultData + ((u64)Timestep + 1)*ValuesPerTimestep;
+}
+
+//NOTE: Store the state of the last run of the data set at the start of the given Timestep in Checkpoint, i.e. the state after Timestep timesteps were computed. Timestep can be anything from 0 (the initial values) to TimestepsLastRun (the end of the run). HistoryTimesteps is how many timesteps before that to also store, which is needed to restart models that use EARLIER_RESULT.
+static void
+SaveCheckpoint(mobius_data_set *DataSet, u64 Timestep, model_checkpoint *Checkpoint, u64 HistoryTimesteps = 0)
+{
+	if(!DataSet->HasBeenRun || !DataSet->ResultData)
+		FatalError("ERROR: Tried to save a checkpoint of a data set that has not been run.\n");
+	
+	if(Timestep > DataSet->TimestepsLastRun)
+		FatalError("ERROR: Tried to save a checkpoint at timestep ", Timestep, ", but the last run only had ", DataSet->TimestepsLastRun, " timesteps.\n");
+	
+	size_t ValuesPerTimestep = DataSet->ResultStorageStructure.TotalCount;
+	
+	Checkpoint->ValuesPerTimestep = ValuesPerTimestep;
+	Checkpoint->HistoryTimesteps  = HistoryTimesteps;
+	Checkpoint->Structure         = ResultFileDescription(DataSet);
+	Checkpoint->Results.resize(ValuesPerTimestep*(HistoryTimesteps + 1));
+	
+	for(u64 Back = 0; Back <= HistoryTimesteps; ++Back)
+	{
+		s64 RowTimestep = (s64)Timestep - 1 - (s64)Back;
+		const double *Row = GetResultRowLastRun(DataSet, RowTimestep);
+		if(!Row)
+			FatalError("ERROR: Tried to save a checkpoint at timestep ", Timestep, " with ", HistoryTimesteps, " timesteps of history, but the results of timestep ", RowTimestep, " are not stored in the data set. Use SetResultWindow to keep more timesteps.\n");
+		memcpy(Checkpoint->Results.data() + Back*ValuesPerTimestep, Row, sizeof(double)*ValuesPerTimestep);
+	}
+	
+	expanded_datetime Date(DataSet->StartDateLastRun, DataSet->Model->TimestepSize);
+	for(u64 Step = 0; Step < Timestep; ++Step)
+		Date.Advance();
+	Checkpoint->Date = Date.DateTime;
+}
+
+//NOTE: Let the following runs of the data set start from Checkpoint instead of from the initial values. This also sets the "Start date" parameter to the date of the checkpoint. The checkpoint is checked against the data set when the run starts, since the index sets may not have been set up yet.
+static void
+RestartFromCheckpoint(mobius_data_set *DataSet, const model_checkpoint &Checkpoint)
+{
+	if(Checkpoint.Results.size() != Checkpoint.ValuesPerTimestep*(Checkpoint.HistoryTimesteps + 1) || Checkpoint.ValuesPerTimestep == 0)
+		FatalError("ERROR: Tried to restart from a checkpoint that does not contain any state.\n");
+	
+	if(DataSet->Model->Parameters.NameToHandle.find("Start date") == DataSet->Model->Parameters.NameToHandle.end())
+		FatalError("ERROR: Can only restart from a checkpoint in models that have a \"Start date\" parameter.\n");
+	
+	parameter_value StartDate;
+	StartDate.ValTime = Checkpoint.Date;
+	SetParameterValue(DataSet, "Start date", nullptr, 0, StartDate, ParameterType_Time);
+	
+	DataSet->Restart = Checkpoint;
+	DataSet->ParameterDataLastRun.clear();   //NOTE: The initial state changed, so an incremental run has to start from the beginning.
+}
+
+//NOTE: Let the following runs of the data set start from the initial values again.
+static void
+ClearRestartCheckpoint(mobius_data_set *DataSet)
+{
+	DataSet->Restart = {};
+	DataSet->ParameterDataLastRun.clear();
+}
+
+//NOTE: Called by the model run after the initial values are computed. Replaces the initial values by the state in the restart checkpoint.
+static void
+ApplyRestartCheckpoint(mobius_data_set *DataSet, datetime ModelStartTime)
+{
+	const model_checkpoint &Restart = DataSet->Restart;
+	
+	if(Restart.ValuesPerTimestep != DataSet->ResultStorageStructure.TotalCount || Restart.Structure != ResultFileDescription(DataSet))
+		FatalError("ERROR: The checkpoint that the data set is restarted from was saved from a different model or index structure.\n");
+	
+	datetime RestartDate = Restart.Date;
+	if(RestartDate.SecondsSinceEpoch != ModelStartTime.SecondsSinceEpoch)
+		FatalError("ERROR: The \"Start date\" was changed to ", std::string(ModelStartTime.ToString()), " after the data set was set to restart from a checkpoint at ", std::string(RestartDate.ToString()), ". Use ClearRestartCheckpoint to start from the initial values instead.\n");
+	
+	memcpy(DataSet->ResultData, Restart.Results.data(), sizeof(double)*Restart.ValuesPerTimestep);
+}
+
+static void
+WriteCheckpointToFile(const model_checkpoint &Checkpoint, const char *Filename)
+{
+	FILE *File;
+#ifdef _WIN32
+	std::u16string Filename16 = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(Filename);
+	File = _wfopen((wchar_t *)Filename16.data(), L"wb");
+#else
+	File = fopen(Filename, "wb");
+#endif
+	
+	if(!File)
+		FatalError("ERROR: Tried to open file \"", Filename, "\", but was not able to.\n");
+	
+	checkpoint_file_header Header = {};
+	memcpy(Header.Magic, "MOBIUSCP", 8);
+	Header.Version           = 1;
+	Header.ValueSize         = sizeof(double);
+	Header.Date              = Checkpoint.Date.SecondsSinceEpoch;
+	Header.ValuesPerTimestep = Checkpoint.ValuesPerTimestep;
+	Header.HistoryTimesteps  = Checkpoint.HistoryTimesteps;
+	Header.StructureSize     = Checkpoint.Structure.size();
+	
+	bool Success = fwrite(&Header, sizeof(Header), 1, File) == 1;
+	Success = Success && fwrite(Checkpoint.Structure.data(), 1, Checkpoint.Structure.size(), File) == Checkpoint.Structure.size();
+	Success = Success && fwrite(Checkpoint.Results.data(), sizeof(double), Checkpoint.Results.size(), File) == Checkpoint.Results.size();
+	fclose(File);
+	
+	if(!Success)
+		FatalError("ERROR: Was not able to write the checkpoint to the file \"", Filename, "\".\n");
+}
+
+static void
+ReadCheckpointFromFile(model_checkpoint *Checkpoint, const char *Filename)
+{
+	FILE *File;
+#ifdef _WIN32
+	std::u16string Filename16 = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(Filename);
+	File = _wfopen((wchar_t *)Filename16.data(), L"rb");
+#else
+	File = fopen(Filename, "rb");
+#endif
+	
+	if(!File)
+		FatalError("ERROR: Tried to open file \"", Filename, "\", but was not able to.\n");
+	
+	checkpoint_file_header Header;
+	if(fread(&Header, sizeof(Header), 1, File) != 1 || memcmp(Header.Magic, "MOBIUSCP", 8) != 0)
+	{
+		fclose(File);
+		FatalError("ERROR: The file \"", Filename, "\" is not a checkpoint file.\n");
+	}
+	if(Header.Version != 1 || Header.ValueSize != sizeof(double))
+	{
+		fclose(File);
+		FatalError("ERROR: The checkpoint file \"", Filename, "\" was written by an unsupported version of Mobius.\n");
+	}
+	
+	Checkpoint->Date.SecondsSinceEpoch = Header.Date;
+	Checkpoint->ValuesPerTimestep      = Header.ValuesPerTimestep;
+	Checkpoint->HistoryTimesteps       = Header.HistoryTimesteps;
+	Checkpoint->Structure.resize(Header.StructureSize);
+	Checkpoint->Results.resize(Header.ValuesPerTimestep*(Header.HistoryTimesteps + 1));
+	
+	bool Success = fread(&Checkpoint->Structure[0], 1, Checkpoint->Structure.size(), File) == Checkpoint->Structure.size();
+	Success = Success && fread(Checkpoint->Results.data(), sizeof(double), Checkpoint->Results.size(), File) == Checkpoint->Results.size();
+	fclose(File);
+	
+	if(!Success)
+		FatalError("ERROR: The checkpoint file \"", Filename, "\" is truncated.\n");
+}
+
+#define MOBIUS_CHECKPOINT_H
+#endif
@@ -34,11 +34,45 @@ GenerateDataSet(mobius_model *Model)
 	return DataSet;
 }
 
+static void
+FreeRunContext(mobius_run_context *Context);
+
+static void
+MapResultFile(mobius_data_set *DataSet, u64 Timesteps);
+
+static void
+UnmapResultFile(mobius_data_set *DataSet);
+
+static void
+WriteResultFileHeader(mobius_data_set *DataSet, u64 Timesteps);
+
+static void
+FreeResultColumns(mobius_data_set *DataSet)
+{
+	if(DataSet->ResultColumns) free(DataSet->ResultColumns);
+	DataSet->ResultColumns = nullptr;
+}
+
+static void
+FreeResultData(mobius_data_set *DataSet)
+{
+	if(DataSet->ResultFile)
+		UnmapResultFile(DataSet);
+	else if(DataSet->ResultData)
+		free(DataSet->ResultData);
+	DataSet->ResultData = nullptr;
+}
+
 mobius_data_set::~mobius_data_set()
 {
+	if(RunContext) FreeRunContext(RunContext);
+	
 	if(ParameterData) free(ParameterData);
-	if(InputData) free(InputData);
-	if(ResultData) free(ResultData);
+	//NOTE: The InputData is freed by the InputDataOwner when no other data set shares it.
+	FreeResultData(this);
+	if(KeptResultData) free(KeptResultData);
+	if(ResultDataFloat) free(ResultDataFloat);
+	FreeResultColumns(this);
 	
 	BucketMemory.DeallocateAll();
 }
@@ -79,10 +113,9 @@ CopyDataSet(mobius_data_set *DataSet, bool CopyResults = false)
 	if(DataSet->ParameterData) Copy->ParameterData = CopyArray(parameter_value, DataSet->ParameterStorageStructure.TotalCount, DataSet->ParameterData);
 	CopyStorageStructure(&DataSet->ParameterStorageStructure, &Copy->ParameterStorageStructure, &Copy->BucketMemory);
 	
-	if(DataSet->InputData)
-		Copy->InputData = CopyArray(double, DataSet->InputStorageStructure.TotalCount * DataSet->InputDataTimesteps, DataSet->InputData);
-	
-	else Copy->InputData = nullptr; //Should not be necessary...
+	//NOTE: The copy shares the input data with the original. Models don't write to their inputs during a run, so the input data only has to be copied if one of them calls SetInputSeries later, see UnshareInputData.
+	Copy->InputData      = DataSet->InputData;
+	Copy->InputDataOwner = DataSet->InputDataOwner;
 	CopyStorageStructure(&DataSet->InputStorageStructure, &Copy->InputStorageStructure, &Copy->BucketMemory);
 	Copy->InputDataStartDate = DataSet->InputDataStartDate;
 	Copy->InputDataHasSeparateStartDate = DataSet->InputDataHasSeparateStartDate;
@@ -90,9 +123,26 @@ CopyDataSet(mobius_data_set *DataSet, bool CopyResults = false)
 	
 	if(DataSet->InputTimeseriesWasProvided) Copy->InputTimeseriesWasProvided = Copy->BucketMemory.Copy(DataSet->InputTimeseriesWasProvided, DataSet->InputStorageStructure.TotalCount);
 	
+	Copy->ResultWindow = DataSet->ResultWindow;
+	Copy->EarlierResultStepBack = DataSet->EarlierResultStepBack;
+	Copy->KeptResults  = DataSet->KeptResults;
+	Copy->StreamingObjectives = DataSet->StreamingObjectives;
+	Copy->SinglePrecisionResults = DataSet->SinglePrecisionResults;
+	Copy->IncrementalRuns = DataSet->IncrementalRuns;
+	Copy->Profiling = DataSet->Profiling;
+	Copy->Restart = DataSet->Restart;
+	Copy->HasRandomSeed = DataSet->HasRandomSeed;
+	Copy->RandomSeed    = DataSet->RandomSeed;
+	Copy->RandomStream  = DataSet->RandomStream;
+	//NOTE: The ResultFilename is not copied, since two data sets can not share a result file. The copy keeps its results in memory.
+	
 	if(CopyResults)
 	{
-		if(DataSet->ResultData) Copy->ResultData = CopyArray(double, DataSet->ResultStorageStructure.TotalCount * (DataSet->TimestepsLastRun + 1), DataSet->ResultData);
+		if(DataSet->ResultData) Copy->ResultData = CopyArray(double, DataSet->ResultStorageStructure.TotalCount * (DataSet->ResultDataTimesteps + 1), DataSet->ResultData);
+		Copy->ResultDataTimesteps = DataSet->ResultDataTimesteps;
+		if(DataSet->KeptResultData) Copy->KeptResultData = CopyArray(double, DataSet->KeptResultOffsets.size() * DataSet->TimestepsLastRun, DataSet->KeptResultData);
+		Copy->KeptResultOffsets = DataSet->KeptResultOffsets;
+		if(DataSet->ResultDataFloat) Copy->ResultDataFloat = CopyArray(float, DataSet->ResultStorageStructure.TotalCount * DataSet->TimestepsLastRun, DataSet->ResultDataFloat);
 		CopyStorageStructure(&DataSet->ResultStorageStructure, &Copy->ResultStorageStructure, &Copy->BucketMemory);
 		Copy->TimestepsLastRun = DataSet->TimestepsLastRun;
 		Copy->StartDateLastRun = DataSet->StartDateLastRun;
@@ -118,7 +168,14 @@ CopyDataSet(mobius_data_set *DataSet, bool CopyResults = false)
 			}
 		}
 	}
-	Copy->IndexNamesToHandle = DataSet->IndexNamesToHandle;
+	//NOTE: The keys of the name maps have to point to the copied names, so that the copy does not depend on the memory of the original.
+	Copy->IndexNamesToHandle.resize(DataSet->IndexNamesToHandle.size());
+	for(index_set_h IndexSet : Model->IndexSets)
+	{
+		if(!Copy->IndexNames || !Copy->IndexNames[IndexSet.Handle]) continue;
+		for(index_t Index = {IndexSet.Handle, 0}; Index < DataSet->IndexCounts[IndexSet.Handle]; ++Index)
+			Copy->IndexNamesToHandle[IndexSet.Handle][Copy->IndexNames[IndexSet.Handle][Index]] = Index;
+	}
 	Copy->AllIndexesHaveBeenSet = DataSet->AllIndexesHaveBeenSet;
 	
 	if(DataSet->BranchInputs)
@@ -131,7 +188,7 @@ CopyDataSet(mobius_data_set *DataSet, bool CopyResults = false)
 				Copy->BranchInputs[IndexSet.Handle] = Copy->BucketMemory.Allocate<array<index_t>>(DataSet->IndexCounts[IndexSet.Handle]);
 				for(index_t Index = {IndexSet.Handle, 0}; Index < DataSet->IndexCounts[IndexSet.Handle]; ++Index)
 				{
-					Copy->BranchInputs[IndexSet.Handle][Index] = DataSet->BranchInputs[IndexSet.Handle][Index].Copy(&DataSet->BucketMemory);
+					Copy->BranchInputs[IndexSet.Handle][Index] = DataSet->BranchInputs[IndexSet.Handle][Index].Copy(&Copy->BucketMemory);
 				}
 			}
 		}
@@ -720,13 +777,24 @@ AllocateInputStorage(mobius_data_set *DataSet, u64 Timesteps)
 
 	
 	DataSet->InputData = AllocClearedArray(double, DataSet->InputStorageStructure.TotalCount * Timesteps);
+	DataSet->InputDataOwner = std::shared_ptr<double>(DataSet->InputData, free);
 	DataSet->InputDataTimesteps = Timesteps;
 	
 	DataSet->InputTimeseriesWasProvided = DataSet->BucketMemory.Allocate<bool>(DataSet->InputStorageStructure.TotalCount);
 }
 
+//NOTE: Give the data set its own copy of the input data if it shares it with other data sets (see CopyDataSet). This has to be called before writing to the input data.
 static void
-AllocateResultStorage(mobius_data_set *DataSet, u64 Timesteps)
+UnshareInputData(mobius_data_set *DataSet)
+{
+	if(DataSet->InputDataOwner.use_count() <= 1) return;
+	
+	DataSet->InputData = CopyArray(double, DataSet->InputStorageStructure.TotalCount * DataSet->InputDataTimesteps, DataSet->InputData);
+	DataSet->InputDataOwner = std::shared_ptr<double>(DataSet->InputData, free);
+}
+
+static void
+SetupResultStorageStructure(mobius_data_set *DataSet)
 {
 	const mobius_model *Model = DataSet->Model;
 	
@@ -762,21 +830,107 @@ AllocateResultStorage(mobius_data_set *DataSet, u64 Timesteps)
 		
 		SetupStorageStructureSpecifer(&DataSet->ResultStorageStructure, DataSet->IndexCounts, Model->Equations.Count(), &DataSet->BucketMemory);
 	}
-	
-	if(DataSet->ResultData && (Timesteps != DataSet->TimestepsLastRun))
+}
+
+static void
+AllocateResultStorage(mobius_data_set *DataSet, u64 Timesteps, bool ClearResults = true, bool KeepAllTimesteps = false)
+{
+	SetupResultStorageStructure(DataSet);
+	
+	FreeResultColumns(DataSet);   //NOTE: The run overwrites the results, so the columnar view of the last run is no longer valid.
+	
+	//NOTE: If a result window is set, we only keep that many of the latest timesteps in ResultData, and store the full series of the KeptResults separately.
+	u64 Window = DataSet->ResultWindow;
+	u64 LookbackWindow = Max(DataSet->Model->MaxEarlierResultStepBack, DataSet->EarlierResultStepBack) + 1; //NOTE: The current timestep and the ones that EARLIER_RESULT (or LAST_RESULT) can read. Lookbacks that depend on parameter values are only known after a run has read them.
+	if(Window != 0) Window = Max(Window, LookbackWindow); //NOTE: SetResultWindow can only check the window against the lookback of the registration run.
+	if(Window == 0 && !DataSet->KeptResults.empty()) Window = LookbackWindow; //NOTE: If outputs were selected, the other results are only kept for as far back as the model reads them unless a window was set.
+	bool FloatHistory = DataSet->SinglePrecisionResults && Window == 0;
+	if(FloatHistory) Window = LookbackWindow; //NOTE: In single precision mode, only the timesteps that the model can read are kept in double precision, and the history is narrowed to float every timestep. The model never reads the float history.
+	u64 StoredTimesteps = Timesteps;
+	if(Window != 0 && !KeepAllTimesteps) StoredTimesteps = Min(Timesteps, Window);   //NOTE: KeepAllTimesteps is used when RunModel runs again because a lookback did not fit in the window.
+	bool Windowed = (StoredTimesteps < Timesteps);
+	FloatHistory = FloatHistory && Windowed;
+	
+	if(Windowed && !DataSet->ResultFilename.empty())
+		FatalError("ERROR: A result file can only be used when the full result series are kept in double precision, not together with a result window, KeepResultSeries or single precision results.\n");
+	
+	if(DataSet->ResultData && (StoredTimesteps != DataSet->ResultDataTimesteps))
 	{
 		//NOTE: We could realloc, but we need to clear it to 0 anyway, so there is probably not that much of a gain.
-		free(DataSet->ResultData);
-		DataSet->ResultData = nullptr;
+		FreeResultData(DataSet);
 	}
 	
 	//NOTE: We add 1 to Timesteps since we also need space for the initial values.
-	size_t AllocationSize = DataSet->ResultStorageStructure.TotalCount * (Timesteps + 1);
+	size_t AllocationSize = DataSet->ResultStorageStructure.TotalCount * (StoredTimesteps + 1);
 	
 	if(!DataSet->ResultData)
-		DataSet->ResultData = AllocClearedArray(double, AllocationSize);
-	else
+	{
+		if(!DataSet->ResultFilename.empty())
+			MapResultFile(DataSet, StoredTimesteps);   //NOTE: A newly created file is already filled with zeros.
+		else
+			DataSet->ResultData = AllocClearedArray(double, AllocationSize);
+	}
+	else if(ClearResults)
 		memset(DataSet->ResultData, 0, sizeof(double)*AllocationSize);
+	
+	if(DataSet->ResultFile)
+		WriteResultFileHeader(DataSet, StoredTimesteps);
+	
+	DataSet->ResultDataTimesteps = StoredTimesteps;
+	
+	size_t KeptCount = DataSet->KeptResultOffsets.size();
+	DataSet->KeptResultOffsets.clear();
+	if(Windowed)
+	{
+		storage_structure<equation_h> &Structure = DataSet->ResultStorageStructure;
+		std::vector<size_t> &Offsets = DataSet->KeptResultOffsets;
+		for(const kept_result_series &Kept : DataSet->KeptResults)
+		{
+			equation_h Equation = Kept.Equation;
+			size_t UnitIndex = Structure.UnitForHandle[Equation.Handle];
+			if(!Kept.Indexes.empty())
+			{
+				size_t Offset = OffsetForHandle(Structure, Kept.Indexes.data(), Kept.Indexes.size(), DataSet->IndexCounts, Equation);
+				if(std::find(Offsets.begin(), Offsets.end(), Offset) == Offsets.end()) Offsets.push_back(Offset);
+				continue;
+			}
+			size_t HandlesInUnit = Structure.Units[UnitIndex].Handles.Count;
+			size_t Instances = Structure.TotalCountForUnit[UnitIndex] / HandlesInUnit;
+			for(size_t Instance = 0; Instance < Instances; ++Instance)
+			{
+				size_t Offset = Structure.OffsetForUnit[UnitIndex] + Instance*HandlesInUnit + Structure.LocationOfHandleInUnit[Equation.Handle];
+				if(std::find(Offsets.begin(), Offsets.end(), Offset) == Offsets.end()) Offsets.push_back(Offset);
+			}
+		}
+	}
+	
+	if(DataSet->KeptResultData && (!Windowed || Timesteps != DataSet->TimestepsLastRun || KeptCount != DataSet->KeptResultOffsets.size()))
+	{
+		free(DataSet->KeptResultData);
+		DataSet->KeptResultData = nullptr;
+	}
+	if(Windowed && !DataSet->KeptResultData && !DataSet->KeptResultOffsets.empty())
+		DataSet->KeptResultData = AllocClearedArray(double, DataSet->KeptResultOffsets.size() * Timesteps);
+	
+	if(DataSet->ResultDataFloat && (!FloatHistory || Timesteps != DataSet->TimestepsLastRun))
+	{
+		free(DataSet->ResultDataFloat);
+		DataSet->ResultDataFloat = nullptr;
+	}
+	if(FloatHistory && !DataSet->ResultDataFloat)
+		DataSet->ResultDataFloat = AllocClearedArray(float, DataSet->ResultStorageStructure.TotalCount * Timesteps);
+}
+
+//NOTE: Only keep the latest Window timesteps of the result of every equation in memory during the next runs. The full series of the results that are given to KeepResultSeries are still stored.
+//Window = 0 (the default) keeps every timestep, unless KeepResultSeries was called, in which case the other results are only kept for as many timesteps as the EARLIER_RESULTs of the model look back (at least the current and last values).
+//The Window has to be larger than the longest lookback of any EARLIER_RESULT in the model. If the lookback depends on a parameter value (such as the routing filter of HBV), it is only found during a run. RunModel then runs again with every timestep stored, and the window is made large enough for the later runs of this data set.
+static void
+SetResultWindow(mobius_data_set *DataSet, u64 Window)
+{
+	u64 LookbackWindow = DataSet->Model->MaxEarlierResultStepBack + 1;
+	if(Window != 0 && Window < LookbackWindow)
+		FatalError("ERROR: The result window has to be at least ", LookbackWindow, " timesteps, since the model \"", DataSet->Model->Name, "\" reads the results of up to ", LookbackWindow - 1, " timesteps back.\n");
+	DataSet->ResultWindow = Window;
 }
 
 
@@ -808,8 +962,98 @@ GetIndex(mobius_data_set *DataSet, index_set_h IndexSet, token_string IndexName,
 	return {IndexSet, 0};
 }
 
+//NOTE: Store the result history of the following runs as float instead of double. This halves the memory used by the results. The results of as many timesteps as the EARLIER_RESULTs of the model look back (see Model->MaxEarlierResultStepBack) are still kept in double precision during the run, so the model never reads the rounded values and its results are the same as in double precision. Lookbacks that depend on parameter values are handled as described at SetResultWindow.
+//This has no effect if a result window is set or outputs are selected with KeepResultSeries, since the full history is not stored then anyway.
+inline void
+SetSinglePrecisionResults(mobius_data_set *DataSet, bool SinglePrecision)
+{
+	DataSet->SinglePrecisionResults = SinglePrecision;
+}
+
+//NOTE: Let the following runs only compute the timesteps from the first one where an input value changed since the last run. The results before that are kept from the last run. This requires that the parameters, the "Start date" and the number of timesteps are the same as in the last run, and that the full result series are kept (i.e. no result window, KeepResultSeries or single precision results). Otherwise the whole run is computed as usual.
+//To find what changed, the data set keeps a copy of the parameters and inputs of the last run, so this doubles the memory used for the input data.
+inline void
+SetIncrementalRuns(mobius_data_set *DataSet, bool Incremental)
+{
+	DataSet->IncrementalRuns = Incremental;
+	DataSet->ParameterDataLastRun.clear();
+	DataSet->InputDataLastRun.clear();
+	DataSet->InputWasProvidedLastRun.clear();
+}
+
+//NOTE: Collect timing information about the following runs in DataSet->Profile: the setup and run time, and cycles and hit counts of every equation, batch group and solver (see run_profile). Use PrintRunProfile to print it. This costs a few reads of the processor clock per equation evaluation, so it should be turned off again when the information is not needed. The profile of the last profiled run is kept when profiling is turned off.
+inline void
+SetProfiling(mobius_data_set *DataSet, bool Profiling)
+{
+	DataSet->Profiling = Profiling;
+}
+
+//NOTE: Make the random draws of equations (UNIFORM_RANDOM_DOUBLE etc.) in the following runs determined by the Seed, so that the runs can be reproduced. Runs with the same Seed and Stream get the same draws. Data sets that should draw independently of each other with the same Seed, such as the members of a stochastic ensemble, should be given different Streams. Copies made with CopyDataSet get the same Seed and Stream as the original.
+inline void
+SetRandomSeed(mobius_data_set *DataSet, u64 Seed, u64 Stream = 0)
+{
+	DataSet->HasRandomSeed = true;
+	DataSet->RandomSeed    = Seed;
+	DataSet->RandomStream  = Stream;
+}
+
+//NOTE: Let every following run draw a new random seed, as is the default.
+inline void
+ClearRandomSeed(mobius_data_set *DataSet)
+{
+	DataSet->HasRandomSeed = false;
+}
+
+//NOTE: Declare that the full result series of an equation is an output of the following model runs, either of every instance of the equation (if IndexCount is 0) or only of the instance given by the IndexNames. Once any outputs are declared, only these get their full series stored. See also SetResultWindow.
 static void
-SetParameterValue(mobius_data_set *DataSet, const char *Name, const char * const *Indexes, size_t IndexCount, parameter_value Value, parameter_type Type)
+KeepResultSeries(mobius_data_set *DataSet, const char *Name, const char * const *IndexNames = nullptr, size_t IndexCount = 0)
+{
+	const mobius_model *Model = DataSet->Model;
+	equation_h Equation = GetEquationHandle(Model, Name);
+	
+	if(Model->Equations[Equation].Type == EquationType_InitialValue)
+		FatalError("ERROR: Can not keep the result series of the equation \"", Name, "\", because it is an initial value equation.\n");
+	
+	kept_result_series Kept;
+	Kept.Equation = Equation;
+	
+	if(IndexCount > 0)
+	{
+		SetupResultStorageStructure(DataSet);
+		
+		size_t StorageUnitIndex = DataSet->ResultStorageStructure.UnitForHandle[Equation.Handle];
+		array<index_set_h> &IndexSets = DataSet->ResultStorageStructure.Units[StorageUnitIndex].IndexSets;
+		if(IndexCount != IndexSets.Count)
+			FatalError("ERROR: Got the wrong amount of indexes when keeping the result series for \"", Name, "\". Got ", IndexCount, ", expected ", IndexSets.Count, ".\n");
+		
+		for(size_t IdxIdx = 0; IdxIdx < IndexCount; ++IdxIdx)
+			Kept.Indexes.push_back(GetIndex(DataSet, IndexSets[IdxIdx], IndexNames[IdxIdx]));
+	}
+	
+	for(const kept_result_series &Other : DataSet->KeptResults)
+	{
+		if(Other.Equation == Kept.Equation && Other.Indexes.size() == Kept.Indexes.size() && std::equal(Other.Indexes.begin(), Other.Indexes.end(), Kept.Indexes.begin()))
+			return;
+	}
+	DataSet->KeptResults.push_back(Kept);
+}
+
+inline void
+KeepResultSeries(mobius_data_set *DataSet, const char *Name, const std::vector<const char *> &IndexNames)
+{
+	KeepResultSeries(DataSet, Name, IndexNames.data(), IndexNames.size());
+}
+
+//NOTE: Go back to storing every result series.
+inline void
+ClearKeptResultSeries(mobius_data_set *DataSet)
+{
+	DataSet->KeptResults.clear();
+}
+
+//NOTE: Find the location in ParameterData of one instance of a parameter, checking that the parameter has the given Type. Writing to DataSet->ParameterData[Offset] is the same as calling SetParameterValue, but without looking up the names every time, e.g. before every run of a calibration. The offset stays valid as long as the index sets of the data set are not changed, and is the same in copies of the data set.
+static size_t
+GetParameterOffset(mobius_data_set *DataSet, const char *Name, const char * const *Indexes, size_t IndexCount, parameter_type Type)
 {
 	if(!DataSet->AllIndexesHaveBeenSet)
 	{
@@ -839,7 +1083,13 @@ SetParameterValue(mobius_data_set *DataSet, const char *Name, const char * const
 	for(size_t Level = 0; Level < IndexCount; ++Level)
 		IndexValues[Level] = GetIndex(DataSet, IndexSetDependencies[Level], Indexes[Level]);
 	
-	size_t Offset = OffsetForHandle(DataSet->ParameterStorageStructure, IndexValues, IndexCount, DataSet->IndexCounts, Parameter);
+	return OffsetForHandle(DataSet->ParameterStorageStructure, IndexValues, IndexCount, DataSet->IndexCounts, Parameter);
+}
+
+static void
+SetParameterValue(mobius_data_set *DataSet, const char *Name, const char * const *Indexes, size_t IndexCount, parameter_value Value, parameter_type Type)
+{
+	size_t Offset = GetParameterOffset(DataSet, Name, Indexes, IndexCount, Type);
 	DataSet->ParameterData[Offset] = Value;
 }
 
@@ -1040,12 +1290,31 @@ SetInputSeries(mobius_data_set *DataSet, const char *Name, const char * const *I
 	if(InputSeriesSize + TimestepOffset > DataSet->InputDataTimesteps)
 		FatalError("ERROR: When setting input series for \"", Name, "\", the lenght of the time series was longer than what was allocated space for in the dataset.\n");
 	
+	auto ValueAt = [InputSeries, InputSeriesSize, TimestepOffset](s64 Idx)
+	{
+		if(Idx >= TimestepOffset && Idx < (s64)InputSeriesSize + TimestepOffset)
+			return InputSeries[Idx - TimestepOffset];
+		return std::numeric_limits<double>::quiet_NaN();
+	};
+	
+	if(DataSet->InputDataOwner.use_count() > 1)
+	{
+		//NOTE: The input data is shared with copies of this data set. Preprocessing steps set the same series again at the start of every run, and we don't want that to make every copy allocate its own input data.
+		bool Changed = !DataSet->InputTimeseriesWasProvided[Offset];
+		for(size_t Idx = 0; Idx < DataSet->InputDataTimesteps && !Changed; ++Idx)
+		{
+			double Value = ValueAt((s64)Idx);
+			Changed = memcmp(&Value, At + Idx*DataSet->InputStorageStructure.TotalCount, sizeof(double)) != 0;
+		}
+		if(!Changed) return;
+		
+		UnshareInputData(DataSet);
+		At = DataSet->InputData + Offset;
+	}
+	
 	for(size_t Idx = 0; Idx < DataSet->InputDataTimesteps; ++Idx)
 	{
-		if(Idx >= TimestepOffset && Idx <= InputSeriesSize + TimestepOffset)
-			*At = InputSeries[Idx - TimestepOffset];
-		else
-			*At = std::numeric_limits<double>::quiet_NaN();
+		*At = ValueAt((s64)Idx);
 		At += DataSet->InputStorageStructure.TotalCount;
 	}
 	
@@ -1058,21 +1327,80 @@ SetInputSeries(mobius_data_set *DataSet, const char *Name, const std::vector<con
 	SetInputSeries(DataSet, Name, IndexNames.data(), IndexNames.size(), InputSeries, InputSeriesSize, AlignWithResults);
 }
 
-// NOTE: The caller of this function has to allocate the space that the result series should be written to and pass a pointer to it as WriteTo.
-// Example:
-// std::vector<double> MyResults;
-// MyResults.resize(DataSet->TimestepsLastRun);
-// GetResultSeries(DataSet, "Percolation input", {"Reach 1", "Forest", "Groundwater"}, MyResult.data(), MyResult.size());
+//NOTE: Copy the result series of the instances at Offsets (locations within one timestep of the result data) from row major Rows, which has one row of RowStride values per timestep, to WriteTo, which gets one column of ColumnStride values per offset. This is done in tiles so that both the rows that are read and the columns that are written stay in cache, which makes it limited by memory bandwidth rather than latency even when there are many results per timestep.
+template<typename value_type>
 static void
-GetResultSeries(mobius_data_set *DataSet, const char *Name, const char* const* IndexNames, size_t IndexCount, double *WriteTo, size_t WriteSize)
-{	
+TransposeResultRows(const value_type *Rows, size_t RowStride, u64 Timesteps, const size_t *Offsets, size_t OffsetCount, double *WriteTo, u64 ColumnStride)
+{
+	const u64    TimestepTile = 128;
+	const size_t OffsetTile   = 16;
+	
+	for(size_t FirstOffset = 0; FirstOffset < OffsetCount; FirstOffset += OffsetTile)
+	{
+		size_t EndOffset = Min(FirstOffset + OffsetTile, OffsetCount);
+		for(u64 FirstTimestep = 0; FirstTimestep < Timesteps; FirstTimestep += TimestepTile)
+		{
+			u64 EndTimestep = Min(FirstTimestep + TimestepTile, Timesteps);
+			for(u64 Timestep = FirstTimestep; Timestep < EndTimestep; ++Timestep)
+			{
+				const value_type *Row = Rows + Timestep*RowStride;
+				for(size_t Idx = FirstOffset; Idx < EndOffset; ++Idx)
+					WriteTo[Idx*ColumnStride + Timestep] = (double)Row[Offsets[Idx]];
+			}
+		}
+	}
+}
+
+//NOTE: Build a column major copy of the results of the last run, so that every result series is contiguous in memory. GetResultSeries and GetResultBlock read from it if it exists, which is much faster when many series are extracted, since the results are otherwise stored one timestep after the other and each series has to be read with a stride of the number of results per timestep.
+//The view takes as much memory as the full result series in double precision, and is freed at the start of the next run. It is not built if only a window of the results was kept during the run, since the series of the KeptResults are already stored column by column.
+static void
+BuildResultColumns(mobius_data_set *DataSet)
+{
 	if(!DataSet->HasBeenRun || !DataSet->ResultData)
-		FatalError("ERROR: Tried to extract result series before the model was run at least once.\n");
+		FatalError("ERROR: Tried to build the result columns before the model was run at least once.\n");
+	if(DataSet->RunWasStopped)
+		FatalError("ERROR: Tried to build the result columns of a model run that was stopped early by a limit of a streaming objective (see SetStreamingObjectiveLimits). The results after the timestep where it was stopped were not computed.\n");
 	
-	const mobius_model *Model = DataSet->Model;
+	if(DataSet->ResultColumns) return;
 	
-	//TODO: If we ask for more values than we could get, should there not be an error?
-	u64 NumToWrite = Min(WriteSize, DataSet->TimestepsLastRun);
+	bool FullHistory = DataSet->ResultDataFloat || DataSet->ResultDataTimesteps >= DataSet->TimestepsLastRun;
+	if(!FullHistory) return;
+	
+	size_t ValuesPerTimestep = DataSet->ResultStorageStructure.TotalCount;
+	u64 Timesteps = DataSet->TimestepsLastRun;
+	
+	std::vector<size_t> Offsets(ValuesPerTimestep);
+	for(size_t Offset = 0; Offset < ValuesPerTimestep; ++Offset) Offsets[Offset] = Offset;
+	
+	DataSet->ResultColumns = AllocClearedArray(double, ValuesPerTimestep*Timesteps);
+	
+	if(DataSet->ResultDataFloat)
+		TransposeResultRows(DataSet->ResultDataFloat, ValuesPerTimestep, Timesteps, Offsets.data(), ValuesPerTimestep, DataSet->ResultColumns, Timesteps);
+	else
+		TransposeResultRows(DataSet->ResultData + ValuesPerTimestep, ValuesPerTimestep, Timesteps, Offsets.data(), ValuesPerTimestep, DataSet->ResultColumns, Timesteps); //NOTE: Skip the row of initial values.
+}
+
+static const char *
+GetResultNameAtOffset(mobius_data_set *DataSet, size_t Offset)
+{
+	storage_structure<equation_h> &Structure = DataSet->ResultStorageStructure;
+	for(size_t UnitIndex = 0; UnitIndex < Structure.Units.Count; ++UnitIndex)
+	{
+		size_t Begin = Structure.OffsetForUnit[UnitIndex];
+		if(Offset < Begin || Offset >= Begin + Structure.TotalCountForUnit[UnitIndex]) continue;
+		array<equation_h> &Handles = Structure.Units[UnitIndex].Handles;
+		return GetName(DataSet->Model, Handles[(Offset - Begin) % Handles.Count]);
+	}
+	return "(unknown)";
+}
+
+//NOTE: Find the location within one timestep of the result data of one instance of a result. The offset can be passed to GetResultSeriesAtOffset to extract the series many times without looking up the names every time, e.g. after every run of a calibration. It stays valid as long as the index sets of the data set are not changed, and can be found before the model is run.
+static size_t
+GetResultOffset(mobius_data_set *DataSet, const char *Name, const char* const* IndexNames, size_t IndexCount)
+{
+	SetupResultStorageStructure(DataSet);
+	
+	const mobius_model *Model = DataSet->Model;
 	
 	equation_h Equation = GetEquationHandle(Model, Name);
 	
@@ -1091,7 +1419,48 @@ GetResultSeries(mobius_data_set *DataSet, const char *Name, const char* const* I
 	for(size_t IdxIdx = 0; IdxIdx < IndexSets.Count; ++IdxIdx)
 		Indexes[IdxIdx] = GetIndex(DataSet, IndexSets[IdxIdx], IndexNames[IdxIdx]);
 
-	size_t Offset = OffsetForHandle(DataSet->ResultStorageStructure, Indexes, IndexCount, DataSet->IndexCounts, Equation);
+	return OffsetForHandle(DataSet->ResultStorageStructure, Indexes, IndexCount, DataSet->IndexCounts, Equation);
+}
+
+static void
+GetResultSeriesAtOffset(mobius_data_set *DataSet, size_t Offset, double *WriteTo, size_t WriteSize)
+{
+	if(!DataSet->HasBeenRun || !DataSet->ResultData)
+		FatalError("ERROR: Tried to extract result series before the model was run at least once.\n");
+	if(DataSet->RunWasStopped)
+		FatalError("ERROR: Tried to extract result series of a model run that was stopped early by a limit of a streaming objective (see SetStreamingObjectiveLimits). The results after the timestep where it was stopped were not computed.\n");
+	
+	//TODO: If we ask for more values than we could get, should there not be an error?
+	u64 NumToWrite = Min(WriteSize, DataSet->TimestepsLastRun);
+	
+	if(DataSet->ResultColumns)
+	{
+		memcpy(WriteTo, DataSet->ResultColumns + Offset*DataSet->TimestepsLastRun, sizeof(double)*NumToWrite);
+		return;
+	}
+	
+	if(DataSet->ResultDataFloat)
+	{
+		float *Lookup = DataSet->ResultDataFloat + Offset;
+		for(size_t Idx = 0; Idx < NumToWrite; ++Idx)
+		{
+			WriteTo[Idx] = (double)*Lookup;
+			Lookup += DataSet->ResultStorageStructure.TotalCount;
+		}
+		return;
+	}
+	
+	if(DataSet->ResultDataTimesteps < DataSet->TimestepsLastRun)
+	{
+		auto Find = std::find(DataSet->KeptResultOffsets.begin(), DataSet->KeptResultOffsets.end(), Offset);
+		if(Find == DataSet->KeptResultOffsets.end())
+			FatalError("ERROR: Tried to get the result series of \"", GetResultNameAtOffset(DataSet, Offset), "\", but only the last ", DataSet->ResultDataTimesteps, " timesteps of it were kept during the model run. Use KeepResultSeries before running the model to keep the full series.\n");
+		
+		double *Series = DataSet->KeptResultData + (Find - DataSet->KeptResultOffsets.begin())*DataSet->TimestepsLastRun;
+		memcpy(WriteTo, Series, sizeof(double)*NumToWrite);
+		return;
+	}
+	
 	double *Lookup = DataSet->ResultData + Offset;
 	
 	for(size_t Idx = 0; Idx < NumToWrite; ++Idx)
@@ -1101,15 +1470,85 @@ GetResultSeries(mobius_data_set *DataSet, const char *Name, const char* const* I
 	}
 }
 
+// NOTE: The caller of this function has to allocate the space that the result series should be written to and pass a pointer to it as WriteTo.
+// Example:
+// std::vector<double> MyResults;
+// MyResults.resize(DataSet->TimestepsLastRun);
+// GetResultSeries(DataSet, "Percolation input", {"Reach 1", "Forest", "Groundwater"}, MyResult.data(), MyResult.size());
+static void
+GetResultSeries(mobius_data_set *DataSet, const char *Name, const char* const* IndexNames, size_t IndexCount, double *WriteTo, size_t WriteSize)
+{
+	size_t Offset = GetResultOffset(DataSet, Name, IndexNames, IndexCount);
+	GetResultSeriesAtOffset(DataSet, Offset, WriteTo, WriteSize);
+}
+
 inline void
 GetResultSeries(mobius_data_set *DataSet, const char *Name, const std::vector<const char*> &IndexNames, double *WriteTo, size_t WriteSize)
 {
 	GetResultSeries(DataSet, Name, IndexNames.data(), IndexNames.size(), WriteTo, WriteSize);
 }
 
+//NOTE: The number of instances of a result, i.e. the product of the index counts of the index sets it depends on.
+static size_t
+GetResultInstanceCount(mobius_data_set *DataSet, const char *Name)
+{
+	if(!DataSet->HasBeenRun || !DataSet->ResultData)
+		FatalError("ERROR: Tried to extract result series before the model was run at least once.\n");
+	
+	equation_h Equation = GetEquationHandle(DataSet->Model, Name);
+	storage_structure<equation_h> &Structure = DataSet->ResultStorageStructure;
+	size_t UnitIndex = Structure.UnitForHandle[Equation.Handle];
+	return Structure.TotalCountForUnit[UnitIndex] / Structure.Units[UnitIndex].Handles.Count;
+}
+
+//NOTE: Extract the series of every instance of a result in one go. WriteTo gets GetResultInstanceCount(DataSet, Name) rows of TimestepsLastRun values, so WriteSize has to be at least their product. The instances are in the order of ForeachResultInstance, i.e. with the index of the last index set the result depends on changing fastest.
+//Without the columns of BuildResultColumns this reads through the results of every equation that has the same index sets as this one, so when extracting most of the results of a large run, call BuildResultColumns first.
+// Example:
+// std::vector<double> Block(GetResultInstanceCount(DataSet, "Soil water volume") * DataSet->TimestepsLastRun);
+// GetResultBlock(DataSet, "Soil water volume", Block.data(), Block.size());
 static void
-GetInputSeries(mobius_data_set *DataSet, const char *Name, const char * const *IndexNames, size_t IndexCount, double *WriteTo, size_t WriteSize, bool AlignWithResults = false)
-{	
+GetResultBlock(mobius_data_set *DataSet, const char *Name, double *WriteTo, size_t WriteSize)
+{
+	const mobius_model *Model = DataSet->Model;
+	
+	size_t Instances = GetResultInstanceCount(DataSet, Name);
+	u64 Timesteps = DataSet->TimestepsLastRun;
+	
+	equation_h Equation = GetEquationHandle(Model, Name);
+	if(Model->Equations[Equation].Type == EquationType_InitialValue)
+		FatalError("ERROR: Can not get the result series of the equation \"", Name, "\", because it is an initial value equation.\n");
+	
+	if(WriteSize < Instances*Timesteps)
+		FatalError("ERROR: Tried to get the ", Instances, " result series of \"", Name, "\", which needs space for ", Instances*Timesteps, " values, but only got space for ", WriteSize, ".\n");
+	if(DataSet->RunWasStopped)
+		FatalError("ERROR: Tried to extract result series of a model run that was stopped early by a limit of a streaming objective (see SetStreamingObjectiveLimits). The results after the timestep where it was stopped were not computed.\n");
+	
+	storage_structure<equation_h> &Structure = DataSet->ResultStorageStructure;
+	size_t UnitIndex = Structure.UnitForHandle[Equation.Handle];
+	size_t HandlesInUnit = Structure.Units[UnitIndex].Handles.Count;
+	
+	std::vector<size_t> Offsets(Instances);
+	for(size_t Instance = 0; Instance < Instances; ++Instance)
+		Offsets[Instance] = Structure.OffsetForUnit[UnitIndex] + Instance*HandlesInUnit + Structure.LocationOfHandleInUnit[Equation.Handle];
+	
+	size_t ValuesPerTimestep = Structure.TotalCount;
+	
+	if(DataSet->ResultColumns || (DataSet->ResultDataTimesteps < DataSet->TimestepsLastRun && !DataSet->ResultDataFloat))
+	{
+		//NOTE: The series are already contiguous.
+		for(size_t Instance = 0; Instance < Instances; ++Instance)
+			GetResultSeriesAtOffset(DataSet, Offsets[Instance], WriteTo + Instance*Timesteps, Timesteps);
+	}
+	else if(DataSet->ResultDataFloat)
+		TransposeResultRows(DataSet->ResultDataFloat, ValuesPerTimestep, Timesteps, Offsets.data(), Instances, WriteTo, Timesteps);
+	else
+		TransposeResultRows(DataSet->ResultData + ValuesPerTimestep, ValuesPerTimestep, Timesteps, Offsets.data(), Instances, WriteTo, Timesteps); //NOTE: Skip the row of initial values.
+}
+
+//NOTE: Find the location within one timestep of InputData of one instance of an input.
+static size_t
+GetInputOffset(mobius_data_set *DataSet, const char *Name, const char * const *IndexNames, size_t IndexCount)
+{
 	if(!DataSet->InputData)
 		FatalError("ERROR: Tried to extract input series before input data was allocated.\n");
 	
@@ -1127,7 +1566,15 @@ GetInputSeries(mobius_data_set *DataSet, const char *Name, const char * const *I
 	for(size_t IdxIdx = 0; IdxIdx < IndexSets.Count; ++IdxIdx)
 		Indexes[IdxIdx] = GetIndex(DataSet, IndexSets[IdxIdx], IndexNames[IdxIdx]);
 
-	size_t Offset = OffsetForHandle(DataSet->InputStorageStructure, Indexes, IndexCount, DataSet->IndexCounts, Input);
+	return OffsetForHandle(DataSet->InputStorageStructure, Indexes, IndexCount, DataSet->IndexCounts, Input);
+}
+
+static void
+GetInputSeries(mobius_data_set *DataSet, const char *Name, const char * const *IndexNames, size_t IndexCount, double *WriteTo, size_t WriteSize, bool AlignWithResults = false)
+{	
+	const mobius_model *Model = DataSet->Model;
+	
+	size_t Offset = GetInputOffset(DataSet, Name, IndexNames, IndexCount);
 	double *Lookup = DataSet->InputData + Offset;
 	
 	s64 TimestepOffset = 0;
@@ -1157,6 +1604,57 @@ GetInputSeries(mobius_data_set *DataSet, const char *Name, const std::vector<con
 	GetInputSeries(DataSet, Name, IndexNames.data(), IndexNames.size(), WriteTo, WriteSize, AlignWithResults);
 }
 
+//NOTE: Compare the result at ResultOffset (see GetResultOffset) to the input at InputOffset (see GetInputOffset) in every timestep of the following model runs, starting at timestep DiscardTimesteps. This is done while the model runs, so the result series does not have to be kept (see SetResultWindow). After a run, DataSet->StreamingObjectives[Idx] holds the statistics of that run, where Idx is the returned index. If the same comparison was already added, its index is returned instead of adding it again.
+static size_t
+AddStreamingObjective(mobius_data_set *DataSet, size_t ResultOffset, size_t InputOffset, u64 DiscardTimesteps = 0)
+{
+	SetupResultStorageStructure(DataSet);
+	if(ResultOffset >= DataSet->ResultStorageStructure.TotalCount || InputOffset >= DataSet->InputStorageStructure.TotalCount)
+		FatalError("ERROR: Got an offset for a streaming objective that is outside the result or input storage.\n");
+	
+	std::vector<streaming_objective> &Objectives = DataSet->StreamingObjectives;
+	for(size_t Idx = 0; Idx < Objectives.size(); ++Idx)
+	{
+		if(Objectives[Idx].ResultOffset == ResultOffset && Objectives[Idx].InputOffset == InputOffset && Objectives[Idx].DiscardTimesteps == DiscardTimesteps)
+			return Idx;
+	}
+	
+	streaming_objective Objective = {};
+	Objective.ResultOffset     = ResultOffset;
+	Objective.InputOffset      = InputOffset;
+	Objective.DiscardTimesteps = DiscardTimesteps;
+	Objective.MaxSumAbsResidual     = std::numeric_limits<double>::infinity();
+	Objective.MaxSumSquaredResidual = std::numeric_limits<double>::infinity();
+	Objectives.push_back(Objective);
+	return Objectives.size() - 1;
+}
+
+inline size_t
+AddStreamingObjective(mobius_data_set *DataSet, const char *ResultName, const std::vector<const char *> &ResultIndexes, const char *InputName, const std::vector<const char *> &InputIndexes, u64 DiscardTimesteps = 0)
+{
+	size_t ResultOffset = GetResultOffset(DataSet, ResultName, ResultIndexes.data(), ResultIndexes.size());
+	size_t InputOffset  = GetInputOffset(DataSet, InputName, InputIndexes.data(), InputIndexes.size());
+	return AddStreamingObjective(DataSet, ResultOffset, InputOffset, DiscardTimesteps);
+}
+
+//NOTE: Stop the following runs as soon as the sum of the absolute or the squared residuals of a streaming objective grows above the given limit. This is useful when the run would be discarded anyway if the objective is bad enough, since these sums can only grow during a run. Infinite limits (the default) never stop the run.
+static void
+SetStreamingObjectiveLimits(mobius_data_set *DataSet, size_t ObjectiveIdx, double MaxSumAbsResidual, double MaxSumSquaredResidual)
+{
+	if(ObjectiveIdx >= DataSet->StreamingObjectives.size())
+		FatalError("ERROR: Tried to set the limits of a streaming objective that was not added to this data set.\n");
+	
+	streaming_objective &Objective = DataSet->StreamingObjectives[ObjectiveIdx];
+	Objective.MaxSumAbsResidual     = MaxSumAbsResidual;
+	Objective.MaxSumSquaredResidual = MaxSumSquaredResidual;
+}
+
+inline void
+ClearStreamingObjectives(mobius_data_set *DataSet)
+{
+	DataSet->StreamingObjectives.clear();
+}
+
 static bool
 InputSeriesWasProvided(mobius_data_set *DataSet, const char *Name, const char * const *IndexNames, size_t IndexCount)
 {
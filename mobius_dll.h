@@ -1,9 +1,16 @@
-
 #include <sstream>
+#include <mutex>
+
+//NOTE: Errors are recorded per thread, so that a thread that calls into the dll only ever sees its own errors in DllEncounteredError, even if other threads are running other data sets at the same time. FatalError carries the message with the exception it throws, so that errors that happen on worker threads (see RunModelsParallel) can be passed on to the thread that made the call. Warnings are collected from all threads.
+struct dll_fatal_error
+{
+	std::string Message;
+};
 
-static int Dll_GlobalErrorCode = 0;
-std::stringstream Dll_GlobalErrstream;
+static thread_local int Dll_GlobalErrorCode = 0;
+static thread_local std::stringstream Dll_GlobalErrstream;
 
+static std::mutex Dll_GlobalWarningMutex;
 static int Dll_GlobalWarningCode = 0;
 std::stringstream Dll_GlobalWarningStream;
 
@@ -24,19 +31,31 @@ void
 FatalError(v... Tail)
 {
 	ErrorPrint(Tail...);
-	throw 1;
+	dll_fatal_error Error;
+	Error.Message = Dll_GlobalErrstream.str();
+	Dll_GlobalErrorCode = 0;
+	Dll_GlobalErrstream.str(std::string());
+	throw Error;
 }	
 
 void
-WarningPrint() {}
+WarningPrintLocked() {}
 
 template<typename t, typename... v>
 void
-WarningPrint(t Value, v... Tail)
+WarningPrintLocked(t Value, v... Tail)
 {
-	Dll_GlobalWarningCode = 1;
 	Dll_GlobalWarningStream << Value;
-	WarningPrint(Tail...);
+	WarningPrintLocked(Tail...);
+}
+
+template<typename... v>
+void
+WarningPrint(v... Tail)
+{
+	std::lock_guard<std::mutex> Lock(Dll_GlobalWarningMutex);
+	Dll_GlobalWarningCode = 1;
+	WarningPrintLocked(Tail...);
 }
 
 #define MOBIUS_ERROR_OVERRIDE	
@@ -48,7 +67,9 @@ WarningPrint(t Value, v... Tail)
 try {
 
 #define CHECK_ERROR_END \
-} catch(int Errcode) { \
+} catch(const dll_fatal_error &Error) { \
+	Dll_GlobalErrorCode = 1; \
+	Dll_GlobalErrstream << Error.Message; \
 }
 
 #if (defined(_WIN32) || defined(_WIN64))
@@ -57,11 +78,22 @@ try {
 	#define DLLEXPORT extern "C" __attribute((visibility("default")))
 #endif
 
+//NOTE: The message buffers passed to DllEncounteredError and DllEncounteredWarning have to hold at least this many characters. Longer messages are cut off.
+#define MOBIUS_DLL_MESSAGE_BUFFER_SIZE 1024
+
+static void
+DllCopyMessage(char *MsgOut, const std::string &Msg)
+{
+	size_t Length = Min(Msg.size(), (size_t)MOBIUS_DLL_MESSAGE_BUFFER_SIZE - 1);
+	memcpy(MsgOut, Msg.data(), Length);
+	MsgOut[Length] = 0;
+}
+
 DLLEXPORT int
 DllEncounteredError(char *ErrmsgOut)
 {
 	std::string ErrStr = Dll_GlobalErrstream.str();
-	strcpy(ErrmsgOut, ErrStr.c_str());
+	DllCopyMessage(ErrmsgOut, ErrStr);
 	
 	int Code = Dll_GlobalErrorCode;
 	
@@ -74,8 +106,9 @@ DllEncounteredError(char *ErrmsgOut)
 DLLEXPORT int
 DllEncounteredWarning(char *WarningmsgOut)
 {
+	std::lock_guard<std::mutex> Lock(Dll_GlobalWarningMutex);
 	std::string WarnStr = Dll_GlobalWarningStream.str();
-	strcpy(WarningmsgOut, WarnStr.c_str());
+	DllCopyMessage(WarningmsgOut, WarnStr);
 	
 	int Code = Dll_GlobalWarningCode;
 	
@@ -221,6 +254,16 @@ DllRunModel(void *DataSetPtr)
 	CHECK_ERROR_END
 }
 
+DLLEXPORT void
+DllRunModelsParallel(void **DataSetPtrs, u64 Count, s32 ThreadCount)
+{
+	CHECK_ERROR_BEGIN
+	
+	RunModelsParallel((mobius_data_set **)DataSetPtrs, (size_t)Count, (int)ThreadCount);
+	
+	CHECK_ERROR_END
+}
+
 DLLEXPORT void *
 DllCopyDataSet(void *DataSetPtr, bool CopyResults)
 {
@@ -352,6 +395,277 @@ DllGetResultSeries(void *DataSetPtr, char *Name, char **IndexNames, u64 IndexCou
 	CHECK_ERROR_END
 }
 
+DLLEXPORT u64
+DllGetResultInstanceCount(void *DataSetPtr, char *Name)
+{
+	CHECK_ERROR_BEGIN
+	
+	return (u64)GetResultInstanceCount((mobius_data_set *)DataSetPtr, Name);
+	
+	CHECK_ERROR_END
+	
+	return 0;
+}
+
+//NOTE: WriteTo gets DllGetResultInstanceCount rows of DllGetTimesteps values, see GetResultBlock.
+DLLEXPORT void
+DllGetResultBlock(void *DataSetPtr, char *Name, double *WriteTo)
+{
+	CHECK_ERROR_BEGIN
+	
+	mobius_data_set *DataSet = (mobius_data_set *)DataSetPtr;
+	
+	size_t WriteSize = GetResultInstanceCount(DataSet, Name) * DataSet->TimestepsLastRun;
+	
+	GetResultBlock(DataSet, Name, WriteTo, WriteSize);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllBuildResultColumns(void *DataSetPtr)
+{
+	CHECK_ERROR_BEGIN
+	
+	BuildResultColumns((mobius_data_set *)DataSetPtr);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllSetResultWindow(void *DataSetPtr, u64 Window)
+{
+	CHECK_ERROR_BEGIN
+	
+	SetResultWindow((mobius_data_set *)DataSetPtr, Window);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllSetResultFile(void *DataSetPtr, char *Filename)
+{
+	CHECK_ERROR_BEGIN
+	
+	SetResultFile((mobius_data_set *)DataSetPtr, Filename);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllSetIncrementalRuns(void *DataSetPtr, bool Incremental)
+{
+	CHECK_ERROR_BEGIN
+	
+	SetIncrementalRuns((mobius_data_set *)DataSetPtr, Incremental);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllSetRandomSeed(void *DataSetPtr, u64 Seed, u64 Stream)
+{
+	CHECK_ERROR_BEGIN
+	
+	SetRandomSeed((mobius_data_set *)DataSetPtr, Seed, Stream);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllClearRandomSeed(void *DataSetPtr)
+{
+	CHECK_ERROR_BEGIN
+	
+	ClearRandomSeed((mobius_data_set *)DataSetPtr);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllSaveCheckpoint(void *DataSetPtr, char *Filename, s64 Timestep, u64 HistoryTimesteps)
+{
+	CHECK_ERROR_BEGIN
+	
+	mobius_data_set *DataSet = (mobius_data_set *)DataSetPtr;
+	//NOTE: A negative Timestep means the end of the last run.
+	if(Timestep < 0) Timestep = (s64)DataSet->TimestepsLastRun;
+	
+	model_checkpoint Checkpoint;
+	SaveCheckpoint(DataSet, (u64)Timestep, &Checkpoint, HistoryTimesteps);
+	WriteCheckpointToFile(Checkpoint, Filename);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllRestartFromCheckpoint(void *DataSetPtr, char *Filename)
+{
+	CHECK_ERROR_BEGIN
+	
+	model_checkpoint Checkpoint;
+	ReadCheckpointFromFile(&Checkpoint, Filename);
+	RestartFromCheckpoint((mobius_data_set *)DataSetPtr, Checkpoint);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllClearRestartCheckpoint(void *DataSetPtr)
+{
+	CHECK_ERROR_BEGIN
+	
+	ClearRestartCheckpoint((mobius_data_set *)DataSetPtr);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllSetProfiling(void *DataSetPtr, bool Profiling)
+{
+	CHECK_ERROR_BEGIN
+	
+	SetProfiling((mobius_data_set *)DataSetPtr, Profiling);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT u64
+DllGetBatchGroupCount(void *DataSetPtr)
+{
+	CHECK_ERROR_BEGIN
+	
+	return (u64)((mobius_data_set *)DataSetPtr)->Model->BatchGroups.Count;
+	
+	CHECK_ERROR_END
+	
+	return 0;
+}
+
+DLLEXPORT u64
+DllGetBatchGroupIndexSetsCount(void *DataSetPtr, u64 BatchGroupIdx)
+{
+	CHECK_ERROR_BEGIN
+	
+	const mobius_model *Model = ((mobius_data_set *)DataSetPtr)->Model;
+	if(BatchGroupIdx >= Model->BatchGroups.Count)
+		FatalError("ERROR: The model only has ", Model->BatchGroups.Count, " batch groups.\n");
+	
+	return (u64)Model->BatchGroups[BatchGroupIdx].IndexSets.Count;
+	
+	CHECK_ERROR_END
+	
+	return 0;
+}
+
+DLLEXPORT void
+DllGetBatchGroupIndexSets(void *DataSetPtr, u64 BatchGroupIdx, const char **NamesOut)
+{
+	CHECK_ERROR_BEGIN
+	
+	const mobius_model *Model = ((mobius_data_set *)DataSetPtr)->Model;
+	if(BatchGroupIdx >= Model->BatchGroups.Count)
+		FatalError("ERROR: The model only has ", Model->BatchGroups.Count, " batch groups.\n");
+	
+	const equation_batch_group &BatchGroup = Model->BatchGroups[BatchGroupIdx];
+	for(size_t Idx = 0; Idx < BatchGroup.IndexSets.Count; ++Idx)
+		NamesOut[Idx] = GetName(Model, BatchGroup.IndexSets[Idx]);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT u64
+DllGetAllSolversCount(void *DataSetPtr)
+{
+	CHECK_ERROR_BEGIN
+	
+	return (u64)(((mobius_data_set *)DataSetPtr)->Model->Solvers.Count() - 1);
+	
+	CHECK_ERROR_END
+	
+	return 0;
+}
+
+DLLEXPORT void
+DllGetAllSolvers(void *DataSetPtr, const char **NamesOut)
+{
+	CHECK_ERROR_BEGIN
+	
+	const mobius_model *Model = ((mobius_data_set *)DataSetPtr)->Model;
+	for(solver_h Solver : Model->Solvers)
+		NamesOut[Solver.Handle - 1] = GetName(Model, Solver);
+	
+	CHECK_ERROR_END
+}
+
+//NOTE: Reads the profile of the last profiled run (see SetProfiling). TimesOut gets 5 values: setup milliseconds, run milliseconds, setup cycles, run cycles and the number of timesteps that were computed. The equation arrays are in the order of DllGetAllResults with all modules, the batch group arrays have DllGetBatchGroupCount entries, and the solver arrays are in the order of DllGetAllSolvers.
+DLLEXPORT void
+DllGetRunProfile(void *DataSetPtr, u64 *TimesOut, u64 *EquationCyclesOut, u64 *EquationHitsOut, u64 *BatchGroupCyclesOut, u64 *BatchGroupHitsOut, u64 *SolverCyclesOut, u64 *SolverHitsOut, u64 *SolverEvaluationsOut)
+{
+	CHECK_ERROR_BEGIN
+	
+	mobius_data_set *DataSet = (mobius_data_set *)DataSetPtr;
+	const run_profile &Profile = DataSet->Profile;
+	
+	if(Profile.EquationHits.empty())
+		FatalError("ERROR: Tried to read the run profile of a data set that has not been run with profiling turned on.\n");
+	
+	TimesOut[0] = Profile.SetupMilliseconds;
+	TimesOut[1] = Profile.RunMilliseconds;
+	TimesOut[2] = Profile.SetupCycles;
+	TimesOut[3] = Profile.RunCycles;
+	TimesOut[4] = Profile.Timesteps;
+	
+	for(size_t Idx = 1; Idx < Profile.EquationHits.size(); ++Idx)
+	{
+		EquationCyclesOut[Idx - 1] = Profile.EquationCycles[Idx];
+		EquationHitsOut[Idx - 1]   = Profile.EquationHits[Idx];
+	}
+	for(size_t Idx = 0; Idx < Profile.BatchGroupHits.size(); ++Idx)
+	{
+		BatchGroupCyclesOut[Idx] = Profile.BatchGroupCycles[Idx];
+		BatchGroupHitsOut[Idx]   = Profile.BatchGroupHits[Idx];
+	}
+	for(size_t Idx = 1; Idx < Profile.SolverHits.size(); ++Idx)
+	{
+		SolverCyclesOut[Idx - 1]      = Profile.SolverCycles[Idx];
+		SolverHitsOut[Idx - 1]        = Profile.SolverHits[Idx];
+		SolverEvaluationsOut[Idx - 1] = Profile.SolverEvaluations[Idx];
+	}
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllSetSinglePrecisionResults(void *DataSetPtr, bool SinglePrecision)
+{
+	CHECK_ERROR_BEGIN
+	
+	SetSinglePrecisionResults((mobius_data_set *)DataSetPtr, SinglePrecision);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllKeepResultSeries(void *DataSetPtr, char *Name, char **IndexNames, u64 IndexCount)
+{
+	CHECK_ERROR_BEGIN
+	
+	KeepResultSeries((mobius_data_set *)DataSetPtr, Name, IndexNames, (size_t)IndexCount);
+	
+	CHECK_ERROR_END
+}
+
+DLLEXPORT void
+DllClearKeptResultSeries(void *DataSetPtr)
+{
+	CHECK_ERROR_BEGIN
+	
+	ClearKeptResultSeries((mobius_data_set *)DataSetPtr);
+	
+	CHECK_ERROR_END
+}
+
 DLLEXPORT void
 DllGetInputSeries(void *DataSetPtr, char *Name, char **IndexNames, u64 IndexCount, double *WriteTo, bool AlignWithResults)
 {
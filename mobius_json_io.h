@@ -127,6 +127,8 @@ WriteResultsToJson(mobius_data_set *DataSet, const char *Filename)
 				{"data", nullptr},
 			};
    
+	BuildResultColumns(DataSet);   //NOTE: Every result is exported, so it pays to transpose all of them at once.
+	
 	//index_t CurrentIndexes[256];
 	for(equation_h Equation : Model->Equations)
 	{
@@ -136,11 +138,18 @@ WriteResultsToJson(mobius_data_set *DataSet, const char *Filename)
 		
 		const char *EquationName = Spec.Name;
 		
+		//NOTE: Extract all the instances at once, which is much faster than doing it series by series. ForeachResultInstance visits the instances in the same order as they are in the block.
+		size_t Stride = (size_t)DataSet->TimestepsLastRun;
+		std::vector<double> Block(GetResultInstanceCount(DataSet, EquationName) * Stride);
+		GetResultBlock(DataSet, EquationName, Block.data(), Block.size());
+		size_t Instance = 0;
+		
 		ForeachResultInstance(DataSet, EquationName,
-			[DataSet, Timesteps, EquationName, &Json](const char * const *IndexNames, size_t IndexesCount)
+			[Timesteps, Stride, &Block, &Instance, &Json, EquationName](const char * const *IndexNames, size_t IndexesCount)
 			{
 				std::vector<double> Values((size_t)Timesteps);
-				GetResultSeries(DataSet, EquationName, IndexNames, IndexesCount, Values.data(), Values.size());
+				memcpy(Values.data(), Block.data() + Instance*Stride, sizeof(double)*Min((size_t)Timesteps, Stride));
+				++Instance;
 				
 				std::vector<std::string> Indices(IndexesCount);
 				for(size_t Idx = 0; Idx < IndexesCount; ++Idx) Indices[Idx] = IndexNames[Idx];
@@ -67,6 +67,38 @@ Clamp01(double A)
 	return A;
 }
 
+//NOTE: The finalizer of the splitmix64 generator. Scrambles the bits of X so that inputs that differ in only a few bits give unrelated outputs.
+inline u64
+MixBits64(u64 X)
+{
+	X = (X ^ (X >> 30)) * 0xBF58476D1CE4E5B9ull;
+	X = (X ^ (X >> 27)) * 0x94D049BB133111EBull;
+	return X ^ (X >> 31);
+}
+
+//NOTE: The Philox4x32-10 counter based random generator (Salmon et al. 2011, "Parallel random numbers: as easy as 1, 2, 3"). It turns a 128 bit Counter and a 64 bit Key into 128 random bits. Every counter value gives an independent draw, so a number can be drawn directly from its position in the stream without generating the ones before it.
+inline void
+Philox4x32(const u32 *Counter, const u32 *Key, u32 *Out)
+{
+	u32 C0 = Counter[0], C1 = Counter[1], C2 = Counter[2], C3 = Counter[3];
+	u32 K0 = Key[0], K1 = Key[1];
+	for(int Round = 0; Round < 10; ++Round)
+	{
+		if(Round > 0)
+		{
+			K0 += 0x9E3779B9;
+			K1 += 0xBB67AE85;
+		}
+		u64 P0 = (u64)0xD2511F53 * C0;
+		u64 P1 = (u64)0xCD9E8D57 * C2;
+		C0 = (u32)(P1 >> 32) ^ C1 ^ K0;
+		C1 = (u32)P1;
+		C2 = (u32)(P0 >> 32) ^ C3 ^ K1;
+		C3 = (u32)P0;
+	}
+	Out[0] = C0; Out[1] = C1; Out[2] = C2; Out[3] = C3;
+}
+
 
 #define MOBIUS_MATH_H
 #endif
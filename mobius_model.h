@@ -199,7 +199,32 @@ struct module_spec
 struct equation_batch;
 struct model_run_state;
 
-typedef std::function<double(model_run_state *)> mobius_equation;
+typedef double mobius_equation_function(void *Closure, model_run_state *RunState);
+
+//NOTE: An equation body is stored as a plain function pointer together with a pointer to the captured state of the lambda that was passed to EQUATION. The function pointer is a thunk instantiated for the exact lambda type, so the lambda body gets inlined into it. This way calling an equation is one direct indirect call instead of going through the type erasure of std::function.
+struct mobius_equation
+{
+	mobius_equation_function *Call;
+	void *Closure;
+	void (*FreeClosure)(void *Closure);
+	
+	inline double operator()(model_run_state *RunState) const
+	{
+		return Call(Closure, RunState);
+	}
+};
+
+template<typename functor> double
+CallEquationFunctor(void *Closure, model_run_state *RunState)
+{
+	return (*(functor *)Closure)(RunState);
+}
+
+template<typename functor> void
+FreeEquationFunctor(void *Closure)
+{
+	delete (functor *)Closure;
+}
 
 typedef std::function<void(size_t, size_t, double)> mobius_matrix_insertion_function;
 
@@ -298,8 +323,11 @@ struct equation_spec
 	std::set<equation_h>  DirectLastResultDependencies;
 	std::set<equation_h>  CrossIndexResultDependencies;
 	
+	bool Hoisted;        //NOTE: The value only depends on parameters (and on the results of other hoisted equations), so it is only evaluated once per instance at the start of each run. See HoistedValueSetupInnerLoop.
+	
 	//TODO: The following should probably just be stored separately in a temporary structure in the EndModelDefinition procedure, as it is not reused outside of that procedure.
 	std::vector<result_dependency_registration> IndexedResultAndLastResultDependencies;
+	std::vector<index_set_h> SetResultIndexSets; //NOTE: The index sets that the equation overrides with explicit indexes when it uses SET_RESULT.
 	
 	bool TempVisited; //NOTE: For use in a graph traversal algorithm while resolving dependencies in EndModelDefinition.
 	bool Visited;     //NOTE: For use in a graph traversal algorithm while resolving dependencies in EndModelDefinition.
@@ -382,6 +410,9 @@ struct equation_batch_group
 	array<iteration_data> IterationData;
 
 	array<equation_h> InitialValueOrder; //NOTE: The initial value setup of equations happens in a different order than the execution order during model run because the intial value equations may have different dependencies than the equations they are initial values for.
+	
+	bool InstancesAreIndependent; //NOTE: True if no instance of IndexSets[0] reads the current result of another instance of IndexSets[0] in this batch group. Used by MOBIUS_PARALLEL_INSTANCES.
+	bool InstancesFollowBranches; //NOTE: True if IndexSets[0] is a branched index set and the instances only read the current results of their branch inputs. Used by MOBIUS_PARALLEL_INSTANCES.
 };
 
 
@@ -442,6 +473,7 @@ struct mobius_model
 	
 	timestep_size TimestepSize;
 	
+	u64 MaxEarlierResultStepBack = 1; //NOTE: The most timesteps back that an equation reads a result from, as seen by the EARLIER_RESULTs of the dependency registration (LAST_RESULT is 1 step back). Used to size the result window, see AllocateResultStorage.
 	
 	timer DefinitionTimer;
 	bool Finalized;
@@ -470,6 +502,84 @@ ForAllBatchEquations(const batch_like &Batch, std::function<bool(equation_h)> Do
 	}
 }
 
+struct mobius_data_set;
+struct mobius_run_context;
+struct result_file_mapping;
+
+struct kept_result_series
+{
+	equation_h Equation;
+	std::vector<index_t> Indexes;   //NOTE: If this is empty, every instance of the Equation is kept.
+};
+
+//NOTE: Statistics of the residuals between one instance of a result and one instance of an input (typically an observed series) that are accumulated during a model run as the result is computed, so that a goodness of fit can be found without storing the result series. See AddStreamingObjective.
+struct streaming_objective
+{
+	size_t ResultOffset;       //NOTE: The location within one timestep of ResultData and InputData of the modeled and the observed value.
+	size_t InputOffset;
+	u64 DiscardTimesteps;      //NOTE: The first timesteps of a run that are not counted, e.g. as spin-up.
+	
+	//NOTE: The following are reset at the start of every run. Only the timesteps where neither the modeled nor the observed value is NaN are counted.
+	u64    Count;
+	double SumAbsResidual;
+	double SumSquaredResidual;
+	double MeanObserved;                 //NOTE: Together with SumSquaredDeviationObserved, the running mean and variance of the observed values (Welford's method).
+	double SumSquaredDeviationObserved;
+	double SumLogAbsModeled;             //NOTE: These two give the log likelyhood of a normal error model with standard deviation proportional to the modeled value, for any proportionality constant.
+	double SumSquaredRelativeResidual;
+	
+	//NOTE: The two sums of residuals can only grow during a run. If one of them grows above its limit, Exceeded is set and the run is stopped at the end of that timestep. See SetStreamingObjectiveLimits.
+	double MaxSumAbsResidual;
+	double MaxSumSquaredResidual;
+	bool   Exceeded;
+};
+
+//NOTE: The state of a model run at the start of a timestep, which a later run can be restarted from. See mobius_checkpoint.h.
+struct model_checkpoint
+{
+	datetime Date;                 //NOTE: The date of the first timestep that is computed by a run that is restarted from this checkpoint.
+	u64 ValuesPerTimestep = 0;     //NOTE: ResultStorageStructure.TotalCount of the data set the checkpoint was taken from.
+	u64 HistoryTimesteps  = 0;     //NOTE: How many timesteps of results before the state are also stored, so that EARLIER_RESULT can look back past the restart.
+	std::string Structure;         //NOTE: Description of the model and result structure (see ResultFileDescription), used to check that the checkpoint fits the data set it is restarted in.
+	std::vector<double> Results;   //NOTE: (HistoryTimesteps+1) rows of ValuesPerTimestep values. Row 0 is the state, i.e. the results of the timestep before Date, and row K holds the results of K timesteps before that.
+};
+
+//NOTE: Timing information about the last run of a data set. It is only collected if profiling is turned on with SetProfiling, or if Mobius is compiled with MOBIUS_EQUATION_PROFILING. Cycles are counted with __rdtsc().
+//The equation vectors are indexed by equation handle, the solver vectors by solver handle, and the batch group vectors by the position of the batch group in Model->BatchGroups. The cycles of a solver include the evaluations of the equations on it, which are also counted for those equations.
+struct run_profile
+{
+	u64 SetupMilliseconds;   //NOTE: Time spent in BeginModelRun, i.e. setting up storage, lookups and initial values.
+	u64 RunMilliseconds;     //NOTE: Time spent computing the timesteps.
+	u64 SetupCycles;
+	u64 RunCycles;
+	u64 Timesteps;           //NOTE: The number of timesteps that were computed. This is smaller than TimestepsLastRun in an incremental run.
+	
+	std::vector<u64> EquationCycles;
+	std::vector<u64> EquationHits;      //NOTE: The number of evaluations. Equations on a solver are evaluated many times per timestep.
+	std::vector<u64> BatchGroupCycles;
+	std::vector<u64> BatchGroupHits;    //NOTE: The number of times the batch group was run, i.e. once per timestep.
+	std::vector<u64> SolverCycles;
+	std::vector<u64> SolverHits;        //NOTE: The number of times the solver was called, i.e. once per timestep for every instance of every batch that uses it.
+	std::vector<u64> SolverEvaluations; //NOTE: The number of times the solver evaluated its system of ODEs. This measures the amount of steps the solver took, although different solvers use a different number of evaluations per step.
+};
+
+inline void
+ClearRunProfile(const mobius_model *Model, run_profile *Profile)
+{
+	Profile->SetupMilliseconds = 0;
+	Profile->RunMilliseconds   = 0;
+	Profile->SetupCycles       = 0;
+	Profile->RunCycles         = 0;
+	Profile->Timesteps         = 0;
+	Profile->EquationCycles.assign(Model->Equations.Count(), 0);
+	Profile->EquationHits.assign(Model->Equations.Count(), 0);
+	Profile->BatchGroupCycles.assign(Model->BatchGroups.Count, 0);
+	Profile->BatchGroupHits.assign(Model->BatchGroups.Count, 0);
+	Profile->SolverCycles.assign(Model->Solvers.Count(), 0);
+	Profile->SolverHits.assign(Model->Solvers.Count(), 0);
+	Profile->SolverEvaluations.assign(Model->Solvers.Count(), 0);
+}
+
 
 struct mobius_data_set
 {
@@ -481,6 +591,7 @@ struct mobius_data_set
 	storage_structure<parameter_h> ParameterStorageStructure;
 		
 	double *InputData;
+	std::shared_ptr<double> InputDataOwner;   //NOTE: Owns InputData, which can be shared between a data set and its copies. See CopyDataSet and UnshareInputData.
 	bool   *InputTimeseriesWasProvided;
 	storage_structure<input_h> InputStorageStructure;
 	datetime InputDataStartDate;
@@ -489,6 +600,29 @@ struct mobius_data_set
 	
 	double *ResultData;
 	storage_structure<equation_h> ResultStorageStructure;
+	u64 ResultDataTimesteps;   //NOTE: The amount of timesteps (not counting the initial values) that ResultData has room for. If this is smaller than TimestepsLastRun, ResultData is a ring buffer of the latest timesteps.
+	
+	u64 ResultWindow = 0;                         //NOTE: If nonzero, only the latest ResultWindow timesteps of each result are kept in ResultData. See SetResultWindow.
+	u64 EarlierResultStepBack = 0;                //NOTE: The largest StepBack of an EARLIER_RESULT that did not fit in the result window in an earlier run of this data set. Used together with Model->MaxEarlierResultStepBack to size the window, see AllocateResultStorage.
+	std::vector<kept_result_series> KeptResults;  //NOTE: Results that have their full series stored in KeptResultData when only a window of the results is kept. See KeepResultSeries.
+	std::vector<size_t> KeptResultOffsets;   //NOTE: The location within one timestep of ResultData of each instance of the KeptResults.
+	double *KeptResultData = nullptr;        //NOTE: KeptResultData[Idx*TimestepsLastRun + Timestep] is the value of the instance at KeptResultOffsets[Idx].
+	
+	std::vector<streaming_objective> StreamingObjectives;   //NOTE: Updated at the end of every timestep of a run. See AddStreamingObjective.
+	bool RunWasStopped = false;   //NOTE: If true, the last run was stopped early because a streaming objective exceeded one of its limits, and the timesteps after that were not computed. The result getters (GetResultSeries etc.) give an error for such a run.
+	
+	bool SinglePrecisionResults = false;     //NOTE: If true, the result history is stored as float in ResultDataFloat, while ResultData only holds the latest timesteps in double precision. See SetSinglePrecisionResults.
+	float *ResultDataFloat = nullptr;        //NOTE: ResultDataFloat[Timestep*ResultStorageStructure.TotalCount + Offset]. Does not contain the initial values.
+	
+	double *ResultColumns = nullptr;         //NOTE: ResultColumns[Offset*TimestepsLastRun + Timestep]. A column major copy of the results of the last run, without the initial values. Only exists between a call to BuildResultColumns and the next run.
+	
+	std::string ResultFilename;                 //NOTE: If not empty, ResultData is stored in a memory mapped file with this name. See SetResultFile.
+	result_file_mapping *ResultFile = nullptr;  //NOTE: The mapping that ResultData currently lives in, if any. See mobius_result_file.h.
+	
+	bool IncrementalRuns = false;                      //NOTE: If true, a run only computes the timesteps from the first one whose inputs changed since the last run. See SetIncrementalRuns.
+	std::vector<parameter_value> ParameterDataLastRun; //NOTE: Copies of the parameters and inputs as they were during the last completed run, used by IncrementalRuns. Empty if there is nothing to compare against.
+	std::vector<double> InputDataLastRun;
+	std::vector<u8> InputWasProvidedLastRun;
 	
 	index_t *IndexCounts;
 	const char ***IndexNames;  // IndexNames[IndexSet.Handle][IndexNamesToHandle[IndexSet.Handle][IndexName]] == IndexName;
@@ -502,6 +636,17 @@ struct mobius_data_set
 	u64 TimestepsLastRun;
 	datetime StartDateLastRun;
 	
+	model_checkpoint Restart;   //NOTE: If Restart.Results is not empty, runs start from this checkpoint instead of from the initial values. See RestartFromCheckpoint.
+	
+	bool Profiling = false;     //NOTE: If true, timing information about each run is collected in Profile. See SetProfiling.
+	run_profile Profile;
+	
+	bool HasRandomSeed = false; //NOTE: If true, the random draws in equations are determined by RandomSeed and RandomStream, so that runs can be reproduced. Otherwise every run gets a new seed. See SetRandomSeed.
+	u64  RandomSeed    = 0;
+	u64  RandomStream  = 0;
+	
+	mobius_run_context *RunContext = nullptr;   //NOTE: State that is kept between calls to RunModel on this data set. See mobius_model_run.h.
+	
 	~mobius_data_set();
 };
 
@@ -509,6 +654,15 @@ struct mobius_data_set
 #define MOBIUS_EQUATION_PROFILING 0
 #endif
 
+//NOTE: Runs of data sets that have no random seed set (see SetRandomSeed) take a unique number from a process wide counter and mix it with the clock to get their seed. Unlike std::random_device this is safe to call from several threads at the same time, and data sets that are started at the same moment on different threads still get different seeds.
+static std::atomic<u64> Mobius_RunSeedCounter(0);
+
+inline u64
+GenerateRunSeed()
+{
+	return MixBits64(Mobius_RunSeedCounter.fetch_add(1) * 0x9E3779B97F4A7C15ull + (u64)std::chrono::high_resolution_clock::now().time_since_epoch().count());
+}
+
 struct model_run_state
 {
 	// The purpose of the model_run_state is to store temporary state that is needed during a model run as well as providing an access point to data that is needed when evaluating equations.
@@ -548,18 +702,26 @@ struct model_run_state
 	array<size_t>          FastResultLookup;
 	array<size_t>          FastLastResultLookup;
 	
+	array<size_t>          FastParameterOffsets; //NOTE: Where in DataSet->ParameterData each entry of FastParameterLookup was read from.
+	
 	parameter_value *AtParameterLookup;
 	size_t *AtInputLookup;
 	size_t *AtResultLookup;
 	size_t *AtLastResultLookup;
 	
+	const mobius_equation *EquationBodies;   //NOTE: The equation bodies that are called during the run. This is Model->EquationBodies, except that hoisted equations are replaced by a lookup in HoistedValues.
+	double *HoistedValues;                   //NOTE: The values of the hoisted equations, at the same location as they have in a timestep of the result data. Only allocated if the model has hoisted equations.
+	bool   *HoistedThisRun;                  //NOTE: Which equations are hoisted in the current run. This leaves out the hoisted equations that turned out to read the time for the current parameter values.
+	bool    ReadTime;                        //NOTE: An equation read CURRENT_TIME() or CURRENT_TIMESTEP(). Set both during dependency registration and during the run.
+	
 	double *SolverTempX0;          //NOTE: Temporary storage for use by solvers
 	double *SolverTempWorkStorage; //NOTE: Temporary storage for use by solvers
 	double *JacobianTempStorage;   //NOTE: Temporary storage for use by Jacobian estimation
 	
 
 	//So that some models can do random generation
-	std::mt19937 RandomGenerator;
+	u32 RandomKey[2];        //NOTE: The key of the counter based generator for the draws of this run. See DrawRandomBits.
+	bool DrewRandomNumbers;  //NOTE: An equation drew a random number during this run, or during the earlier runs that an incremental run reuses the results of.
 	
 	//NOTE: For use during dependency registration:
 	std::vector<dependency_registration<parameter_h>> ParameterDependencies;
@@ -567,12 +729,12 @@ struct model_run_state
 	std::vector<result_dependency_registration> ResultDependencies;
 	std::vector<result_dependency_registration> LastResultDependencies;
 	std::vector<index_set_h> DirectIndexSetDependencies;
+	bool RegisteredSetResult;        //NOTE: The equation used SET_RESULT.
+	u64  MaxStepBack;                //NOTE: The largest StepBack of an EARLIER_RESULT in any of the equations registered so far. During a run, the largest StepBack that did not fit in the result window instead (0 if none did), see GetEarlierResult.
+	std::vector<index_set_h> SetResultIndexSets; //NOTE: The index sets of the explicit indexes passed to SET_RESULT.
 
 	
-#if MOBIUS_EQUATION_PROFILING
-	size_t *EquationHits;
-	u64 *EquationTotalCycles;
-#endif
+	run_profile *Profile;   //NOTE: Where timing information is collected during the run, or nullptr if the run is not profiled.
 	
 	//NOTE: For dependency registration run:
 	model_run_state(const mobius_model *Model)
@@ -580,6 +742,17 @@ struct model_run_state
 		Running = false;
 		DataSet = nullptr;
 		this->Model = Model;
+		ReadTime = false;
+		RegisteredSetResult = false;
+		MaxStepBack = 1;
+		EquationBodies = Model->EquationBodies.data();
+		HoistedValues = nullptr;
+		HoistedThisRun = nullptr;
+		Profile = nullptr;
+		Timestep = 0;
+		RandomKey[0] = 0;
+		RandomKey[1] = 0;
+		DrewRandomNumbers = false;
 	}
 	
 	//NOTE: For proper run:
@@ -601,6 +774,11 @@ struct model_run_state
 		for(index_set_h IndexSet : Model->IndexSets)
 			CurrentIndexes[IndexSet.Handle].IndexSetHandle = IndexSet.Handle;
 		
+		EquationBodies = Model->EquationBodies.data();
+		HoistedValues = nullptr;
+		HoistedThisRun = nullptr;
+		ReadTime = false;
+		Profile = nullptr;
 		
 		Timestep = 0;
 		
@@ -608,19 +786,20 @@ struct model_run_state
 		SolverTempWorkStorage = nullptr;
 		JacobianTempStorage = nullptr;
 		
-		//NOTE: Code borrowed from stack exchange. Should really clean it up!
-		std::random_device Dev;
-		std::mt19937::result_type Seed = Dev() ^ (
-            (std::mt19937::result_type)
-            std::chrono::duration_cast<std::chrono::seconds>(
-                std::chrono::system_clock::now().time_since_epoch()
-                ).count() +
-            (std::mt19937::result_type)
-            std::chrono::duration_cast<std::chrono::microseconds>(
-                std::chrono::high_resolution_clock::now().time_since_epoch()
-                ).count() );
-		
-		RandomGenerator = std::mt19937(Seed);
+		SetRandomKey(GenerateRunSeed());
+		DrewRandomNumbers = false;
+		MaxStepBack = 0;
+	}
+	
+	u64 GetRandomKey()
+	{
+		return ((u64)RandomKey[1] << 32) | (u64)RandomKey[0];
+	}
+	
+	void SetRandomKey(u64 Key)
+	{
+		RandomKey[0] = (u32)Key;
+		RandomKey[1] = (u32)(Key >> 32);
 	}
 	
 	~model_run_state()
@@ -652,25 +831,41 @@ struct model_run_state
 			ResultDependencies.clear();
 			LastResultDependencies.clear();
 			DirectIndexSetDependencies.clear();
+			ReadTime = false;
+			RegisteredSetResult = false;
+			SetResultIndexSets.clear();
 		}
 	}
 };
 
+//NOTE: Stands in for the body of a hoisted equation during a run. RunState->AtResult points to where the result of the equation is stored in the current timestep, and the value is stored at the same location in HoistedValues.
 inline double
-CallEquation(const mobius_model *Model, model_run_state *RunState, equation_h Equation)
+CallHoistedEquation(void *Closure, model_run_state *RunState)
 {
-#if MOBIUS_EQUATION_PROFILING
+	return RunState->HoistedValues[RunState->AtResult - RunState->AllCurResultsBase];
+}
+
+static double
+CallEquationProfiled(model_run_state *RunState, equation_h Equation)
+{
+	const mobius_equation &Body = RunState->EquationBodies[Equation.Handle];
 	u64 Begin = __rdtsc();
-#endif
-	double ResultValue = Model->EquationBodies[Equation.Handle](RunState);
-#if MOBIUS_EQUATION_PROFILING
+	double ResultValue = Body.Call(Body.Closure, RunState);
 	u64 End = __rdtsc();
-	RunState->EquationHits[Equation.Handle]++;
-	RunState->EquationTotalCycles[Equation.Handle] += (End - Begin);
-#endif
+	RunState->Profile->EquationHits[Equation.Handle]++;
+	RunState->Profile->EquationCycles[Equation.Handle] += (End - Begin);
 	return ResultValue;
 }
 
+inline double
+CallEquation(const mobius_model *Model, model_run_state *RunState, equation_h Equation)
+{
+	if(RunState->Profile) return CallEquationProfiled(RunState, Equation);
+	
+	const mobius_equation &Body = RunState->EquationBodies[Equation.Handle];
+	return Body.Call(Body.Closure, RunState);
+}
+
 
 
 #define GET_ENTITY_NAME(Type, NType) \
@@ -1021,8 +1216,8 @@ HideParameter(mobius_model *Model, parameter_h Parameter, bool ShouldNotBeExpose
 }
 
 
-inline void
-SetEquation(mobius_model *Model, equation_h Equation, mobius_equation EquationBody, bool Override = false)
+template<typename functor> void
+SetEquation(mobius_model *Model, equation_h Equation, const functor &EquationBody, bool Override = false)
 {
 	//REGISTRATION_BLOCK(Model) //NOTE: We can't use REGISTRATION_BLOCK since the user don't call the SetEquation explicitly, it is called through the macro EQUATION, and so the error message would be confusing.
 	if(Model->Finalized)
@@ -1037,7 +1232,12 @@ SetEquation(mobius_model *Model, equation_h Equation, mobius_equation EquationBo
 		FatalError("ERROR: The equation body for \"", GetName(Model, Equation), "\" is already defined. It can not be defined twice unless it is explicitly overridden using EQUATION_OVERRIDE.\n");
 	}
 	
-	Model->EquationBodies[Equation.Handle] = EquationBody;
+	mobius_equation &Body = Model->EquationBodies[Equation.Handle];
+	if(Body.FreeClosure) Body.FreeClosure(Body.Closure); //NOTE: In case this is an override.
+	
+	Body.Call        = CallEquationFunctor<functor>;
+	Body.Closure     = new functor(EquationBody);
+	Body.FreeClosure = FreeEquationFunctor<functor>;
 	Model->Equations[Equation].EquationIsSet = true;
 }
 
@@ -1377,24 +1577,35 @@ AddInputIndexSetDependency(mobius_model *Model, input_h Input, index_set_h Index
 #define INPUT(InputH) (RunState__->Running ? GetCurrentInput(RunState__, InputH) : RegisterInputDependency(RunState__, InputH))
 #define RESULT(ResultH, ...) (RunState__->Running ? GetCurrentResult(RunState__, ResultH, ##__VA_ARGS__) : RegisterResultDependency(RunState__, ResultH, ##__VA_ARGS__))
 #define LAST_RESULT(ResultH, ...) (RunState__->Running ? GetLastResult(RunState__, ResultH, ##__VA_ARGS__) : RegisterLastResultDependency(RunState__, ResultH, ##__VA_ARGS__))
-#define EARLIER_RESULT(ResultH, StepBack, ...) (RunState__->Running ? GetEarlierResult(RunState__, ResultH, (StepBack), ##__VA_ARGS__) : RegisterLastResultDependency(RunState__, ResultH, ##__VA_ARGS__))
+#define EARLIER_RESULT(ResultH, StepBack, ...) (RunState__->Running ? GetEarlierResult(RunState__, ResultH, (StepBack), ##__VA_ARGS__) : RegisterEarlierResultDependency(RunState__, ResultH, (StepBack), ##__VA_ARGS__))
 #define INPUT_WAS_PROVIDED(InputH) (RunState__->Running ? GetIfInputWasProvided(RunState__, InputH) : RegisterInputDependency(RunState__, InputH))
 #define IF_INPUT_ELSE_PARAMETER(InputH, ParameterH) (RunState__->Running ? GetCurrentInputOrParameter(RunState__, InputH, ParameterH) : RegisterInputAndParameterDependency(RunState__, InputH, ParameterH))
 
 
+//NOTE: ReadTime is also set during the run, since an equation may only read the time for some parameter values. This is used to check the hoisted equations, see HoistedValueSetupInnerLoop.
 inline const expanded_datetime &
 GetCurrentTime(model_run_state *RunState)
 {
+	RunState->ReadTime = true;
 	return RunState->CurrentTime;
 }
 
+inline s64
+GetCurrentTimestep(model_run_state *RunState)
+{
+	RunState->ReadTime = true;
+	return RunState->Timestep;
+}
+
 #define CURRENT_TIME() (GetCurrentTime(RunState__))
 
-#define CURRENT_TIMESTEP() (RunState__->Timestep)
+#define CURRENT_TIMESTEP() (GetCurrentTimestep(RunState__))
 
+//NOTE: Equation__ and RandomDraw__ are used by the random draw macros (UNIFORM_RANDOM_DOUBLE etc.). They are optimized away in equations that don't draw random numbers.
 #define EQUATION(Model, ResultH, Def) \
 SetEquation(Model, ResultH, \
  [=] (model_run_state *RunState__) { \
+ equation_h Equation__ = ResultH; u32 RandomDraw__ = 0; (void)Equation__; (void)RandomDraw__; \
  Def \
  } \
 );
@@ -1402,6 +1613,7 @@ SetEquation(Model, ResultH, \
 #define EQUATION_OVERRIDE(Model, ResultH, Def) \
 SetEquation(Model, ResultH, \
  [=] (model_run_state *RunState__) { \
+ equation_h Equation__ = ResultH; u32 RandomDraw__ = 0; (void)Equation__; (void)RandomDraw__; \
  Def \
  } \
  , true \
@@ -1438,6 +1650,8 @@ GetCurrentParameter(model_run_state *RunState, parameter_enum_h Parameter)
 //NOTE: Defined in mobius_data_set.h
 template<typename handle_type>
 size_t OffsetForHandle(storage_structure<handle_type> &Structure, const index_t* CurrentIndexes, const index_t *IndexCounts, const index_t *OverrideIndexes, size_t OverrideCount, handle_type Handle);
+template<typename handle_type>
+size_t OffsetForHandle(storage_structure<handle_type> &Structure, const index_t *CurrentIndexes, const index_t *IndexCounts, handle_type Handle);
 
 template<typename... T> double
 GetCurrentParameter(model_run_state *RunState, parameter_double_h Parameter, T... Indexes)
@@ -1526,8 +1740,25 @@ GetEarlierResult(model_run_state *RunState, equation_h Result, u64 StepBack, T..
 	//NOTE: Initial points to the initial value (adding TotalCount once gives us timestep 0)
 	if(StepBack > RunState->Timestep)
 	{
+		//NOTE: If the run was restarted from a checkpoint, the checkpoint may also hold results from before the restart. Otherwise we give the initial value.
+		u64 BeforeStart = StepBack - RunState->Timestep - 1;
+		const model_checkpoint &Restart = DataSet->Restart;
+		if(BeforeStart > 0 && Restart.HistoryTimesteps > 0)
+			return Restart.Results[Min(BeforeStart, Restart.HistoryTimesteps)*Restart.ValuesPerTimestep + Offset];
 		return *Initial;
 	}
+	if(DataSet->ResultDataTimesteps < DataSet->TimestepsLastRun)
+	{
+		//NOTE: Only a window of the latest timesteps is kept. Timestep T is stored at row 1 + T % ResultDataTimesteps.
+		if(StepBack >= DataSet->ResultDataTimesteps)
+		{
+			//NOTE: The lookback depends on something that the registration run could not see, typically a parameter value. We record it so that RunModel can run again with every timestep stored. The value we give here does not matter, since the results of this run are thrown away.
+			RunState->MaxStepBack = Max(RunState->MaxStepBack, StepBack);
+			return *Initial;
+		}
+		u64 Row = 1 + ((u64)RunState->Timestep - StepBack) % DataSet->ResultDataTimesteps;
+		return *(Initial + Row*DataSet->ResultStorageStructure.TotalCount);
+	}
 	return *(Initial + ( (RunState->Timestep+1) - StepBack)*(RunState->DataSet->ResultStorageStructure.TotalCount));
 }
 
@@ -1594,8 +1825,24 @@ RegisterLastResultDependency(model_run_state *RunState, equation_h Result, T...
 	return 0.0;
 }
 
+template<typename... T> double
+RegisterEarlierResultDependency(model_run_state *RunState, equation_h Result, u64 StepBack, T... Indexes)
+{
+	RunState->MaxStepBack = Max(RunState->MaxStepBack, StepBack);
+	return RegisterLastResultDependency(RunState, Result, Indexes...);
+}
+
 //TODO: SET_RESULT is not that nice, and can interfere with how the dependency system works if used incorrectly. It is included to get PERSiST and some other models to work, but should be used with care!
-#define SET_RESULT(ResultH, Value, ...) {if(RunState__->Running){SetResult(RunState__, Value, ResultH, ##__VA_ARGS__);}}
+#define SET_RESULT(ResultH, Value, ...) {if(RunState__->Running){SetResult(RunState__, Value, ResultH, ##__VA_ARGS__);} else {RegisterSetResult(RunState__, ResultH, ##__VA_ARGS__);}}
+
+template<typename... T> void
+RegisterSetResult(model_run_state *RunState, equation_h Result, T... Indexes)
+{
+	RunState->RegisteredSetResult = true;
+	std::vector<index_t> IndexVec = {Indexes...};
+	for(index_t Index : IndexVec)
+		RunState->SetResultIndexSets.push_back(index_set_h {Index.IndexSetHandle});
+}
 
 template<typename... T> void
 SetResult(model_run_state *RunState, double Value, equation_h Result, T... Indexes)
@@ -1645,6 +1892,8 @@ GetInputCount(model_run_state *RunState, index_set_h IndexSet)
 
 
 //NOTE: Ideally we just want to iterate over the  BranchInputs[IndexSet.Handle][Branch] array. The only complicated part is that it can't do that in the registration run, and instead has to iterate over another object that has just one index.
+//NOTE: The index of that object is set to BRANCH_INPUT_REGISTRATION_INDEX so that EndModelDefinition can see which explicitly indexed results were accessed through BRANCH_INPUTS.
+#define BRANCH_INPUT_REGISTRATION_INDEX 0xFFFFFFFF
 
 inline array<index_t>&
 BranchInputs(model_run_state *RunState, index_set_h IndexSet, index_t Index)
@@ -1656,7 +1905,7 @@ BranchInputs(model_run_state *RunState, index_set_h IndexSet, index_t Index)
 	if(RunState->Running)
 		return RunState->DataSet->BranchInputs[IndexSet.Handle][Index.Index];
 	
-	DummyIndex = index_t { IndexSet.Handle, 0};
+	DummyIndex = index_t { IndexSet.Handle, BRANCH_INPUT_REGISTRATION_INDEX};
 	DummyIndexes.Count = 1;
 	DummyIndexes.Data = &DummyIndex;
 	return DummyIndexes;
@@ -1664,22 +1913,61 @@ BranchInputs(model_run_state *RunState, index_set_h IndexSet, index_t Index)
 
 #define BRANCH_INPUTS(IndexSet) BranchInputs(RunState__, IndexSet, CURRENT_INDEX(IndexSet))
 
+//NOTE: Random draws in equations use a counter based generator (Philox4x32). A draw is determined by the key of the run (see SetRandomSeed), the timestep, the equation, the instance of the equation (its location in the result storage), and how many draws the equation body has done before it in the same evaluation. So the draws do not depend on the order the equations and instances are evaluated in, and are the same when running with parallel instances or incrementally as in a plain run. An equation that is evaluated several times in one timestep (e.g. by a solver) gets the same draws every time.
+//Initial value equations are not part of the result storage, so their instance is found from the index sets they depend on instead, and their draws are made as if at the timestep before the first one.
 inline u64
-UniformRandomU64(model_run_state *RunState, u64 Low, u64 High)
+DrawRandomBits(model_run_state *RunState, equation_h Equation, u32 Draw, u32 Attempt)
 {
-	std::uniform_int_distribution<u64> Distribution(Low, High);
-	return Distribution(RunState->RandomGenerator);
+	mobius_data_set *DataSet = RunState->DataSet;
+	const equation_spec &Spec = RunState->Model->Equations[Equation];
+	u64 Instance = 0;
+	if(Spec.Type == EquationType_InitialValue)
+	{
+		for(index_set_h IndexSet : Spec.IndexSetDependencies)
+			Instance = Instance*DataSet->IndexCounts[IndexSet.Handle] + RunState->CurrentIndexes[IndexSet.Handle];
+	}
+	else
+		Instance = OffsetForHandle(DataSet->ResultStorageStructure, RunState->CurrentIndexes, DataSet->IndexCounts, Equation);
+	
+	RunState->DrewRandomNumbers = true;
+	
+	u32 Counter[4] = {(u32)(RunState->Timestep + 1), (u32)Instance, Equation.Handle, (Attempt << 16) | (Draw & 0xFFFF)};
+	u32 Out[4];
+	Philox4x32(Counter, RunState->RandomKey, Out);
+	return ((u64)Out[1] << 32) | (u64)Out[0];
+}
+
+inline u64
+UniformRandomU64(model_run_state *RunState, equation_h Equation, u32 Draw, u64 Low, u64 High)
+{
+	RunState->ReadTime = true; //NOTE: The draws change from timestep to timestep, so the equation can not be hoisted out of the timestep loop.
+	if(!RunState->Running) return Low;
+	
+	u64 Range = High - Low + 1;
+	if(Range == 0) return DrawRandomBits(RunState, Equation, Draw, 0); //NOTE: The full range of u64.
+	
+	//NOTE: Draws below Threshold are rejected so that every value in the range is equally likely.
+	u64 Threshold = (0 - Range) % Range;
+	for(u32 Attempt = 0; ; ++Attempt)
+	{
+		u64 Bits = DrawRandomBits(RunState, Equation, Draw, Attempt);
+		if(Bits >= Threshold) return Low + Bits % Range;
+	}
 }
 
 inline double
-UniformRandomDouble(model_run_state *RunState, double Low, double High)
+UniformRandomDouble(model_run_state *RunState, equation_h Equation, u32 Draw, double Low, double High)
 {
-	std::uniform_real_distribution<double> Distribution(Low, High);
-	return Distribution(RunState->RandomGenerator);
+	RunState->ReadTime = true;
+	if(!RunState->Running) return Low;
+	
+	double Unit = (double)(DrawRandomBits(RunState, Equation, Draw, 0) >> 11) * (1.0 / 9007199254740992.0); //NOTE: 53 random bits, in [0, 1).
+	return Low + (High - Low)*Unit;
 }
 
-#define UNIFORM_RANDOM_UINT(Low, High) (UniformRandomU64(RunState__, Low, High))
-#define UNIFORM_RANDOM_DOUBLE(Low, High) (UniformRandomDouble(RunState__, Low, High))
+//NOTE: Equation__ and RandomDraw__ are declared by the EQUATION macro.
+#define UNIFORM_RANDOM_UINT(Low, High) (UniformRandomU64(RunState__, Equation__, RandomDraw__++, Low, High))
+#define UNIFORM_RANDOM_DOUBLE(Low, High) (UniformRandomDouble(RunState__, Equation__, RandomDraw__++, Low, High))
 
 
 
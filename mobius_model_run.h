@@ -33,6 +33,10 @@ BeginModelDefinition(const char *Name = "(unnamed model)", bool UseEndDate = fal
 
 mobius_model::~mobius_model()
 {
+	for(mobius_equation &Body : EquationBodies)
+	{
+		if(Body.FreeClosure) Body.FreeClosure(Body.Closure);
+	}
 	BucketMemory.DeallocateAll();
 }
 
@@ -769,6 +773,7 @@ EndModelDefinition(mobius_model *Model)
 	for(equation_h Equation : Model->Equations)
 	{
 		equation_spec &Spec = Model->Equations[Equation];
+		Spec.Hoisted = false;
 		
 		if(Spec.Type == EquationType_Cumulative)
 		{
@@ -788,6 +793,9 @@ EndModelDefinition(mobius_model *Model)
 		
 		Spec.IndexSetDependencies.insert(RunState.DirectIndexSetDependencies.begin(), RunState.DirectIndexSetDependencies.end());
 		
+		Spec.Hoisted = !RunState.ReadTime && !RunState.RegisteredSetResult; //NOTE: This is only a candidate for now, see below.
+		Spec.SetResultIndexSets = RunState.SetResultIndexSets;
+		
 		for(auto &ParameterDependency : RunState.ParameterDependencies)
 		{
 			parameter_h Parameter = ParameterDependency.Handle;
@@ -872,6 +880,8 @@ EndModelDefinition(mobius_model *Model)
 			Spec.DirectLastResultDependencies.insert(EqInitialValue);
 	}
 	
+	Model->MaxEarlierResultStepBack = RunState.MaxStepBack;
+	
 	{
 		//NOTE: Check computed parameters to see if their equation satisfies the requirements specified in the documentation:
 		for(parameter_h Parameter : Model->Parameters)
@@ -893,6 +903,35 @@ EndModelDefinition(mobius_model *Model)
 		}
 	}
 	
+	///////////////////// Find the equations that only depend on parameters, so that they can be hoisted out of the timestep loop.
+	
+	//NOTE: An equation is hoisted if it is a basic equation that is not on a solver, that does not read inputs, last results, results with explicit indexes or the time, that does not use SET_RESULT, and that only reads the results of other hoisted equations. Since the registration does not see reads of the time that only happen for some parameter values, this is checked again at the start of each run, see HoistedValueSetupInnerLoop.
+	for(equation_h Equation : Model->Equations)
+	{
+		equation_spec &Spec = Model->Equations[Equation];
+		if(Spec.Type != EquationType_Basic || IsValid(Spec.Solver) || !Spec.InputDependencies.empty() || !Spec.DirectLastResultDependencies.empty() || !Spec.IndexedResultAndLastResultDependencies.empty())
+			Spec.Hoisted = false;
+	}
+	bool HoistingChanged = true;
+	while(HoistingChanged)
+	{
+		HoistingChanged = false;
+		for(equation_h Equation : Model->Equations)
+		{
+			equation_spec &Spec = Model->Equations[Equation];
+			if(!Spec.Hoisted) continue;
+			for(equation_h ResultDependency : Spec.DirectResultDependencies)
+			{
+				if(!Model->Equations[ResultDependency].Hoisted)
+				{
+					Spec.Hoisted = false;
+					HoistingChanged = true;
+					break;
+				}
+			}
+		}
+	}
+	
 	///////////////////// Resolve indirect dependencies of equations on index sets.
 	
 	//TODO: This is probably an inefficient way to do it, we should instead use some kind of graph traversal, but it is tricky. To do it properly one would have to collapse the dependency graph (including both results and lastresults) by its strongly connected components, then resolving the dependencies between the components.  However the current implementation has proven fast enough so far.
@@ -1247,6 +1286,66 @@ EndModelDefinition(mobius_model *Model)
 		}
 	}
 	
+	//////////////////////// Find out which batch groups can compute the instances of their top index set independently of each other //////////////////////////////////
+	
+	{
+		size_t BatchGroupIdx = 0;
+		for(equation_batch_group &BatchGroup : Model->BatchGroups)
+		{
+			bool Independent = (BatchGroup.IndexSets.Count > 0);
+			bool FollowsBranches = Independent && Model->IndexSets[BatchGroup.IndexSets[0]].Type == IndexSetType_Branched;
+			
+			for(size_t BatchIdx = BatchGroup.FirstBatch; BatchIdx <= BatchGroup.LastBatch && (Independent || FollowsBranches); ++BatchIdx)
+			{
+				equation_batch &Batch = Model->EquationBatches[BatchIdx];
+				index_set_h TopIndexSet = BatchGroup.IndexSets[0];
+				
+				ForAllBatchEquations(Batch,
+				[Model, TopIndexSet, BatchGroupIdx, &EquationBelongsToBatchGroup, &Independent, &FollowsBranches](equation_h Equation)
+				{
+					equation_spec &Spec = Model->Equations[Equation];
+					
+					//NOTE: A cumulation over the top index set of a result in this batch group reads the other instances.
+					if(Spec.Type == EquationType_Cumulative && Spec.CumulatesOverIndexSet == TopIndexSet && EquationBelongsToBatchGroup[Spec.Cumulates.Handle] == BatchGroupIdx)
+					{
+						Independent = false;
+						FollowsBranches = false;
+					}
+					
+					//NOTE: A SET_RESULT with an explicit index in the top index set writes to another instance than the current one.
+					for(index_set_h IndexSet : Spec.SetResultIndexSets)
+					{
+						if(IndexSet == TopIndexSet)
+						{
+							Independent = false;
+							FollowsBranches = false;
+						}
+					}
+					
+					//NOTE: LAST_RESULTs and results of earlier batch groups are finished before this batch group runs, so only an explicitly indexed RESULT of this batch group that overrides the top index set can read another instance.
+					for(const result_dependency_registration &Dependency : Spec.IndexedResultAndLastResultDependencies)
+					{
+						if(EquationBelongsToBatchGroup[Dependency.Handle.Handle] != BatchGroupIdx) continue;
+						if(Spec.CrossIndexResultDependencies.find(Dependency.Handle) == Spec.CrossIndexResultDependencies.end()) continue;
+						for(index_t Index : Dependency.Indexes)
+						{
+							if(Index.IndexSetHandle != TopIndexSet.Handle) continue;
+							Independent = false;
+							//NOTE: A branch only waits for its inputs, so every other instance that is read has to be one of the BRANCH_INPUTS.
+							if(Index.Index != BRANCH_INPUT_REGISTRATION_INDEX) FollowsBranches = false;
+						}
+					}
+					return !Independent && !FollowsBranches;
+				});
+			}
+			
+			BatchGroup.InstancesAreIndependent = Independent;
+			//NOTE: If the only thing that ties the instances of a branched index set together is results that are read through BRANCH_INPUTS, a branch can be computed as soon as all its inputs are finished.
+			BatchGroup.InstancesFollowBranches = !Independent && FollowsBranches;
+			++BatchGroupIdx;
+		}
+	}
+	
 	//////////////////////// Gather info about (in-) direct equation dependencies to be used by the Jacobian estimation used by some implicit solvers //////////////////////////////////
 	BuildJacobianInfo(Model);
 	
@@ -1265,51 +1364,56 @@ EndModelDefinition(mobius_model *Model)
 typedef INNER_LOOP_BODY(mobius_inner_loop_body);
 
 static void
-ModelLoop(mobius_data_set *DataSet, model_run_state *RunState, mobius_inner_loop_body InnerLoopBody)
+ModelLoopBatchGroup(mobius_data_set *DataSet, model_run_state *RunState, mobius_inner_loop_body InnerLoopBody, const equation_batch_group &BatchGroup, size_t BatchGroupIdx)
 {
-	const mobius_model *Model = DataSet->Model;
-	size_t BatchGroupIdx = 0;
-	for(const equation_batch_group &BatchGroup : Model->BatchGroups)
-	{	
-		if(BatchGroup.IndexSets.Count == 0)
-		{
-			InnerLoopBody(DataSet, RunState, BatchGroup, BatchGroupIdx, -1);
-			BatchGroupIdx++;
-			continue;
-		}
+	if(BatchGroup.IndexSets.Count == 0)
+	{
+		InnerLoopBody(DataSet, RunState, BatchGroup, BatchGroupIdx, -1);
+		return;
+	}
+	
+	s32 BottomLevel = (s32)BatchGroup.IndexSets.Count - 1;
+	s32 CurrentLevel = 0;
+	
+	while (true)
+	{
+		index_set_h CurrentIndexSet = BatchGroup.IndexSets[CurrentLevel];
 		
-		s32 BottomLevel = (s32)BatchGroup.IndexSets.Count - 1;
-		s32 CurrentLevel = 0;
+		if(RunState->CurrentIndexes[CurrentIndexSet.Handle] != DataSet->IndexCounts[CurrentIndexSet.Handle])
+			InnerLoopBody(DataSet, RunState, BatchGroup, BatchGroupIdx, CurrentLevel);
 		
-		while (true)
+		if(CurrentLevel == BottomLevel)
+			++RunState->CurrentIndexes[CurrentIndexSet.Handle];
+		
+		//NOTE: We need to check again because currentindex may have changed.
+		if(RunState->CurrentIndexes[CurrentIndexSet.Handle] == DataSet->IndexCounts[CurrentIndexSet.Handle])
 		{
-			index_set_h CurrentIndexSet = BatchGroup.IndexSets[CurrentLevel];
-			
-			if(RunState->CurrentIndexes[CurrentIndexSet.Handle] != DataSet->IndexCounts[CurrentIndexSet.Handle])
-				InnerLoopBody(DataSet, RunState, BatchGroup, BatchGroupIdx, CurrentLevel);
+			//NOTE: We are at the end of this index set
 			
-			if(CurrentLevel == BottomLevel)
-				++RunState->CurrentIndexes[CurrentIndexSet.Handle];
-			
-			//NOTE: We need to check again because currentindex may have changed.
-			if(RunState->CurrentIndexes[CurrentIndexSet.Handle] == DataSet->IndexCounts[CurrentIndexSet.Handle])
-			{
-				//NOTE: We are at the end of this index set
-				
-				RunState->CurrentIndexes[CurrentIndexSet.Handle] = {CurrentIndexSet, 0};
-				//NOTE: Traverse up the tree
-				if(CurrentLevel == 0) break; //NOTE: We are finished with this batch group.
-				CurrentLevel--;
-				CurrentIndexSet = BatchGroup.IndexSets[CurrentLevel];
-				++RunState->CurrentIndexes[CurrentIndexSet.Handle]; //Advance the index set above us so that we don't walk down the same branch again.
-				continue;
-			}
-			else if(CurrentLevel != BottomLevel)
-			{
-				//NOTE: If we did not reach the end index, and we are not at the bottom, we instead traverse down the tree again.
-				++CurrentLevel;
-			}
+			RunState->CurrentIndexes[CurrentIndexSet.Handle] = {CurrentIndexSet, 0};
+			//NOTE: Traverse up the tree
+			if(CurrentLevel == 0) break; //NOTE: We are finished with this batch group.
+			CurrentLevel--;
+			CurrentIndexSet = BatchGroup.IndexSets[CurrentLevel];
+			++RunState->CurrentIndexes[CurrentIndexSet.Handle]; //Advance the index set above us so that we don't walk down the same branch again.
+			continue;
 		}
+		else if(CurrentLevel != BottomLevel)
+		{
+			//NOTE: If we did not reach the end index, and we are not at the bottom, we instead traverse down the tree again.
+			++CurrentLevel;
+		}
+	}
+}
+
+static void
+ModelLoop(mobius_data_set *DataSet, model_run_state *RunState, mobius_inner_loop_body InnerLoopBody)
+{
+	const mobius_model *Model = DataSet->Model;
+	size_t BatchGroupIdx = 0;
+	for(const equation_batch_group &BatchGroup : Model->BatchGroups)
+	{
+		ModelLoopBatchGroup(DataSet, RunState, InnerLoopBody, BatchGroup, BatchGroupIdx);
 		++BatchGroupIdx;
 	}
 }
@@ -1376,6 +1480,9 @@ void ODEEquationFunction(double *x0, double *wk, model_run_state *RunState, cons
 	//x0 and wk have to be pre-allocted to be large enough.
 	
 	const mobius_model *Model = RunState->DataSet->Model;
+	
+	if(RunState->Profile) RunState->Profile->SolverEvaluations[Batch->Solver.Handle]++;
+	
 	size_t EquationIdx = 0;
 	//NOTE: Read in initial values of the ODE equations to the CurResults buffer to be accessible from within the batch equations using RESULT(H).
 	//NOTE: Values are not written to ResultData before the entire solution process is finished. So during the solver process one can ONLY read intermediary results from equations belonging to this solver using RESULT(H), never RESULT(H, Idx1,...) etc. However there is no reason one would want to do that any way.
@@ -1403,6 +1510,72 @@ void ODEEquationFunction(double *x0, double *wk, model_run_state *RunState, cons
 	}
 }
 
+static void
+SolveBatch(const mobius_model *Model, model_run_state *RunState, const equation_batch &Batch, s32 CurrentLevel)
+{
+	//NOTE: The results from the last timestep are the initial results for this timestep.
+	size_t EquationIdx = 0;
+	for(equation_h Equation : Batch.EquationsODE)
+	{
+		//NOTE: Reading the Equations.Specs vector here may be slightly inefficient since each element of the vector is large. We could copy out an array of the ResetEveryTimestep bools instead beforehand.
+		if(Model->Equations[Equation].ResetEveryTimestep)
+			RunState->SolverTempX0[EquationIdx] = 0;
+		else
+			RunState->SolverTempX0[EquationIdx] = RunState->LastResults[Equation.Handle]; //NOTE: RunState->LastResults has already been filled with the correct values by the caller.
+		++EquationIdx;
+	}
+	// NOTE: Do we need to clear DataSet->wk to 0? (Has not been needed in the solvers we have used so far...)
+	
+	const solver_spec &SolverSpec = Model->Solvers[Batch.Solver];
+	
+	// The desired solver step. (Guideline only, solver is free to correct its step during error correction).
+	double h = SolverSpec.h;
+	if(IsValid(SolverSpec.hParam)) h = RunState->CurParameters[SolverSpec.hParam.Handle].ValDouble;
+	
+	//NOTE: Solve the system using the provided solver
+	if(RunState->Profile)
+	{
+		u64 Begin = __rdtsc();
+		SolverSpec.SolverFunction(h, Batch.EquationsODE.Count, RunState->SolverTempX0, RunState->SolverTempWorkStorage, &Batch, RunState, SolverSpec.RelErr, SolverSpec.AbsErr);
+		u64 End = __rdtsc();
+		RunState->Profile->SolverHits[Batch.Solver.Handle]++;
+		RunState->Profile->SolverCycles[Batch.Solver.Handle] += (End - Begin);
+	}
+	else
+		SolverSpec.SolverFunction(h, Batch.EquationsODE.Count, RunState->SolverTempX0, RunState->SolverTempWorkStorage, &Batch, RunState, SolverSpec.RelErr, SolverSpec.AbsErr);
+	
+	//NOTE: Store out the final results from this solver to the main dataset.
+	for(equation_h Equation : Batch.Equations)
+	{
+		double ResultValue = RunState->CurResults[Equation.Handle];
+#if MOBIUS_TEST_FOR_NAN
+		NaNTest(Model, RunState, ResultValue, Equation);
+#endif
+		*RunState->AtResult = ResultValue;
+		++RunState->AtResult;
+#if MOBIUS_TIMESTEP_VERBOSITY >= 3
+		for(int Lev = 0; Lev < CurrentLevel; ++Lev) std::cout << "\t";
+		std::cout << "\t" << GetName(Model, Equation) << " = " << ResultValue << std::endl;
+#endif
+	}
+	EquationIdx = 0;
+	for(equation_h Equation : Batch.EquationsODE)
+	{
+		double ResultValue = RunState->SolverTempX0[EquationIdx];
+#if MOBIUS_TEST_FOR_NAN
+		NaNTest(Model, RunState, ResultValue, Equation);
+#endif
+		RunState->CurResults[Equation.Handle] = ResultValue;
+		*RunState->AtResult = ResultValue;
+		++RunState->AtResult;
+		++EquationIdx;
+#if MOBIUS_TIMESTEP_VERBOSITY >= 3
+		for(int Lev = 0; Lev < CurrentLevel; ++Lev) std::cout << "\t";
+		std::cout << "\t" << GetName(Model, Equation) << " = " << ResultValue << std::endl;
+#endif
+	}
+}
+
 INNER_LOOP_BODY(RunInnerLoop)
 {
 	const mobius_model *Model = DataSet->Model;
@@ -1510,58 +1683,7 @@ INNER_LOOP_BODY(RunInnerLoop)
 			}
 			else // IsValid(Batch.Solver)
 			{
-				//NOTE: The results from the last timestep are the initial results for this timestep.
-				size_t EquationIdx = 0;
-				for(equation_h Equation : Batch.EquationsODE)
-				{
-					//NOTE: Reading the Equations.Specs vector here may be slightly inefficient since each element of the vector is large. We could copy out an array of the ResetEveryTimestep bools instead beforehand.
-					if(Model->Equations[Equation].ResetEveryTimestep)
-						RunState->SolverTempX0[EquationIdx] = 0;
-					else
-						RunState->SolverTempX0[EquationIdx] = RunState->LastResults[Equation.Handle]; //NOTE: RunState->LastResults is filled with the correct values already, see above.
-					++EquationIdx;
-				}
-				// NOTE: Do we need to clear DataSet->wk to 0? (Has not been needed in the solvers we have used so far...)
-				
-				const solver_spec &SolverSpec = Model->Solvers[Batch.Solver];
-				
-				// The desired solver step. (Guideline only, solver is free to correct its step during error correction).
-				double h = SolverSpec.h;
-				if(IsValid(SolverSpec.hParam)) h = RunState->CurParameters[SolverSpec.hParam.Handle].ValDouble;
-				
-				//NOTE: Solve the system using the provided solver
-				SolverSpec.SolverFunction(h, Batch.EquationsODE.Count, RunState->SolverTempX0, RunState->SolverTempWorkStorage, &Batch, RunState, SolverSpec.RelErr, SolverSpec.AbsErr);
-				
-				//NOTE: Store out the final results from this solver to the main dataset.
-				for(equation_h Equation : Batch.Equations)
-				{
-					double ResultValue = RunState->CurResults[Equation.Handle];
-#if MOBIUS_TEST_FOR_NAN
-					NaNTest(Model, RunState, ResultValue, Equation);
-#endif
-					*RunState->AtResult = ResultValue;
-					++RunState->AtResult;
-#if MOBIUS_TIMESTEP_VERBOSITY >= 3
-					for(int Lev = 0; Lev < CurrentLevel; ++Lev) std::cout << "\t";
-					std::cout << "\t" << GetName(Model, Equation) << " = " << ResultValue << std::endl;
-#endif
-				}
-				EquationIdx = 0;
-				for(equation_h Equation : Batch.EquationsODE)
-				{
-					double ResultValue = RunState->SolverTempX0[EquationIdx];
-#if MOBIUS_TEST_FOR_NAN
-					NaNTest(Model, RunState, ResultValue, Equation);
-#endif
-					RunState->CurResults[Equation.Handle] = ResultValue;
-					*RunState->AtResult = ResultValue;
-					++RunState->AtResult;
-					++EquationIdx;
-#if MOBIUS_TIMESTEP_VERBOSITY >= 3
-					for(int Lev = 0; Lev < CurrentLevel; ++Lev) std::cout << "\t";
-					std::cout << "\t" << GetName(Model, Equation) << " = " << ResultValue << std::endl;
-#endif
-				}
+				SolveBatch(Model, RunState, Batch, CurrentLevel);
 			}
 		}
 	}
@@ -1591,6 +1713,7 @@ INNER_LOOP_BODY(FastLookupSetupInnerLoop)
 			//NOTE: Parameters are special here in that we can just store the value in the fast lookup, instead of the offset. This is because they don't change with the timestep.
 			size_t Offset = OffsetForHandle(DataSet->ParameterStorageStructure, RunState->CurrentIndexes, DataSet->IndexCounts, Parameter);
 			parameter_value Value = DataSet->ParameterData[Offset];
+			RunState->FastParameterOffsets[RunState->FastParameterLookup.Count] = Offset;
 			RunState->FastParameterLookup[RunState->FastParameterLookup.Count++] = Value;
 		}
 		
@@ -1623,75 +1746,651 @@ INNER_LOOP_BODY(FastLookupSetupInnerLoop)
 }
 
 
-inline double
-SetupInitialValue(mobius_data_set *DataSet, model_run_state *RunState, equation_h Equation)
+//NOTE: The execution plan is a flattened version of what ModelLoop and RunInnerLoop do during one timestep. It is compiled once per run (when the index counts and parameter values are known), and then replayed every timestep. This way the traversal of the index sets, the checks of the current level and the evaluation of conditional switches are not redone every timestep.
+
+enum execution_plan_op_type : u32
+{
+	PlanOp_EnterLevel,        //NOTE: Set the current index of the index set at Level and read in the values needed at that level.
+	PlanOp_ExitLevel,         //NOTE: Reset the current index of the index set at Level.
+	PlanOp_ReadBase,          //NOTE: Read in the last results needed by a batch group without index sets.
+	PlanOp_ReadLastResults,   //NOTE: Read in the last results of all the equations of the batch group.
+	PlanOp_EvaluateBatch,     //NOTE: Evaluate a batch that does not have a solver.
+	PlanOp_SolveBatch,        //NOTE: Solve a batch that has a solver.
+	PlanOp_SkipResults,       //NOTE: Skip the result storage of batches that are turned off by a conditional switch.
+};
+
+struct execution_plan_op
+{
+	execution_plan_op_type Type;
+	u32 BatchGroup;
+	u32 Level;
+	u32 Value;      //NOTE: The index for PlanOp_EnterLevel, the batch for PlanOp_EvaluateBatch and PlanOp_SolveBatch, the amount of results for PlanOp_SkipResults.
+};
+
+struct execution_plan
+{
+	std::vector<execution_plan_op> Ops;
+	std::vector<std::vector<equation_h>> GroupEquations; //NOTE: All the equations of each batch group in the order they are stored in the result data.
+};
+
+static void
+BuildExecutionPlanLevel(mobius_data_set *DataSet, execution_plan *Plan, index_t *CurrentIndexes, const equation_batch_group &BatchGroup, u32 BatchGroupIdx, s32 CurrentLevel)
 {
 	const mobius_model *Model = DataSet->Model;
-	const equation_spec &Spec = Model->Equations[Equation];
+	s32 BottomLevel = (s32)BatchGroup.IndexSets.Count - 1;
 	
-	double Initial = 0.0;
-	if(IsValid(Spec.InitialValue))
+	auto EmitBatches = [&]()
 	{
-		size_t Offset = OffsetForHandle(DataSet->ParameterStorageStructure, RunState->CurrentIndexes, DataSet->IndexCounts, (parameter_h)Spec.InitialValue);
-		//NOTE: We should not get a type mismatch here since we only allow for registering initial values using handles of type parameter_double_h. Thus we do not need to test for which type it is.
-		Initial = DataSet->ParameterData[Offset].ValDouble;
-	}
-	else if(Spec.HasExplicitInitialValue)
-		Initial = Spec.ExplicitInitialValue;
-	else if(IsValid(Spec.InitialValueEquation))
-		Initial = Model->EquationBodies[Spec.InitialValueEquation.Handle](RunState);
-	else
-		//NOTE: Equations without any type of initial value act as their own initial value equation
-		Initial = Model->EquationBodies[Equation.Handle](RunState);
-	
-	size_t ResultStorageLocation = DataSet->ResultStorageStructure.LocationOfHandleInUnit[Equation.Handle];
-	
-#if MOBIUS_TEST_FOR_NAN
-	NaNTest(Model, RunState, Initial, Equation);
-#endif
+		Plan->Ops.push_back({PlanOp_ReadLastResults, BatchGroupIdx, (u32)CurrentLevel, 0});
+		
+		for(size_t BatchIdx = BatchGroup.FirstBatch; BatchIdx <= BatchGroup.LastBatch; ++BatchIdx)
+		{
+			const equation_batch &Batch = Model->EquationBatches[BatchIdx];
+			
+			//NOTE: Parameters don't change during the run, so we can decide once and for all which instances of a conditional batch are turned off.
+			if(IsValid(Batch.ConditionalSwitch))
+			{
+				size_t Offset = OffsetForHandle(DataSet->ParameterStorageStructure, CurrentIndexes, DataSet->IndexCounts, Batch.ConditionalSwitch);
+				if(Batch.ConditionalValue != DataSet->ParameterData[Offset])
+				{
+					u32 Skip = (u32)(Batch.Equations.Count + Batch.EquationsODE.Count);
+					if(!Plan->Ops.empty() && Plan->Ops.back().Type == PlanOp_SkipResults)
+						Plan->Ops.back().Value += Skip;
+					else
+						Plan->Ops.push_back({PlanOp_SkipResults, BatchGroupIdx, (u32)CurrentLevel, Skip});
+					continue;
+				}
+			}
+			
+			execution_plan_op_type Type = IsValid(Batch.Solver) ? PlanOp_SolveBatch : PlanOp_EvaluateBatch;
+			Plan->Ops.push_back({Type, BatchGroupIdx, (u32)CurrentLevel, (u32)BatchIdx});
+		}
+	};
 	
-	RunState->AtResult[ResultStorageLocation] = Initial;
-	RunState->CurResults[Equation.Handle] = Initial;
-	RunState->LastResults[Equation.Handle] = Initial;
+	if(CurrentLevel < 0)
+	{
+		Plan->Ops.push_back({PlanOp_ReadBase, BatchGroupIdx, 0, 0});
+		EmitBatches();
+		return;
+	}
 	
-	return Initial;
+	index_set_h IndexSet = BatchGroup.IndexSets[CurrentLevel];
+	for(index_t Index = {IndexSet, 0}; Index < DataSet->IndexCounts[IndexSet.Handle]; ++Index)
+	{
+		CurrentIndexes[IndexSet.Handle] = Index;
+		Plan->Ops.push_back({PlanOp_EnterLevel, BatchGroupIdx, (u32)CurrentLevel, Index.Index});
+		
+		if(CurrentLevel == BottomLevel)
+			EmitBatches();
+		else
+			BuildExecutionPlanLevel(DataSet, Plan, CurrentIndexes, BatchGroup, BatchGroupIdx, CurrentLevel + 1);
+	}
+	CurrentIndexes[IndexSet.Handle] = {IndexSet, 0};
+	Plan->Ops.push_back({PlanOp_ExitLevel, BatchGroupIdx, (u32)CurrentLevel, 0});
 }
 
-INNER_LOOP_BODY(InitialValueSetupInnerLoop)
+static void
+BuildExecutionPlan(mobius_data_set *DataSet, execution_plan *Plan)
 {
-	// TODO: IMPORTANT!! If an initial value equation depends on the result of an equation from a different batch group than itself, that is not guaranteed to work correctly.
-	// TODO: Currently we don't report an error if that happens!
-	
 	const mobius_model *Model = DataSet->Model;
 	
-	if(CurrentLevel >= 0)
+	Plan->Ops.clear();
+	Plan->GroupEquations.clear();
+	Plan->GroupEquations.resize(Model->BatchGroups.Count);
+	
+	std::vector<index_t> CurrentIndexes(Model->IndexSets.Count());
+	for(index_set_h IndexSet : Model->IndexSets)
+		CurrentIndexes[IndexSet.Handle] = {IndexSet, 0};
+	
+	u32 BatchGroupIdx = 0;
+	for(const equation_batch_group &BatchGroup : Model->BatchGroups)
 	{
-		for(parameter_h Parameter : BatchGroup.IterationData[CurrentLevel].ParametersToRead)
-		{
-			RunState->CurParameters[Parameter.Handle] = *RunState->AtParameterLookup;
-			++RunState->AtParameterLookup;
-		}
-		for(input_h Input : BatchGroup.IterationData[CurrentLevel].InputsToRead)
+		for(size_t BatchIdx = BatchGroup.FirstBatch; BatchIdx <= BatchGroup.LastBatch; ++BatchIdx)
 		{
-			size_t Offset = *RunState->AtInputLookup;
-			++RunState->AtInputLookup;
-			RunState->CurInputs[Input.Handle] = RunState->AllCurInputsBase[Offset];
-			RunState->CurInputWasProvided[Input.Handle] = DataSet->InputTimeseriesWasProvided[Offset];
+			ForAllBatchEquations(Model->EquationBatches[BatchIdx],
+			[Plan, BatchGroupIdx](equation_h Equation)
+			{
+				Plan->GroupEquations[BatchGroupIdx].push_back(Equation);
+				return false;
+			});
 		}
+		
+		s32 TopLevel = BatchGroup.IndexSets.Count ? 0 : -1;
+		BuildExecutionPlanLevel(DataSet, Plan, CurrentIndexes.data(), BatchGroup, BatchGroupIdx, TopLevel);
+		++BatchGroupIdx;
 	}
+}
 
-#if MOBIUS_TIMESTEP_VERBOSITY >= 2
-	if(CurrentLevel >= 0)
+inline void
+ReadIterationData(mobius_data_set *DataSet, model_run_state *RunState, const iteration_data &IterationData)
+{
+	for(parameter_h Parameter : IterationData.ParametersToRead)
 	{
-		index_set_h CurrentIndexSet = BatchGroup.IndexSets[CurrentLevel];
-		for(int Lev = 0; Lev < CurrentLevel; ++Lev) std::cout << "\t";
-		index_t CurrentIndex = RunState->CurrentIndexes[CurrentIndexSet.Handle];
-		std::cout << "*** " << GetName(Model, CurrentIndexSet) << ": " << DataSet->IndexNames[CurrentIndexSet.Handle][CurrentIndex] << std::endl;
+		RunState->CurParameters[Parameter.Handle] = *RunState->AtParameterLookup;
+		++RunState->AtParameterLookup;
 	}
-#endif
-	
-	s32 BottomLevel = BatchGroup.IndexSets.Count - 1;
-	if(CurrentLevel == BottomLevel)
+	for(input_h Input : IterationData.InputsToRead)
+	{
+		size_t Offset = *RunState->AtInputLookup;
+		++RunState->AtInputLookup;
+		RunState->CurInputs[Input.Handle] = RunState->AllCurInputsBase[Offset];
+		RunState->CurInputWasProvided[Input.Handle] = DataSet->InputTimeseriesWasProvided[Offset];
+	}
+	for(equation_h Result : IterationData.ResultsToRead)
+	{
+		size_t Offset = *RunState->AtResultLookup;
+		++RunState->AtResultLookup;
+		RunState->CurResults[Result.Handle] = RunState->AllCurResultsBase[Offset];
+	}
+	for(equation_h Result : IterationData.LastResultsToRead)
+	{
+		size_t Offset = *RunState->AtLastResultLookup;
+		++RunState->AtLastResultLookup;
+		RunState->LastResults[Result.Handle] = RunState->AllLastResultsBase[Offset];
+	}
+}
+
+//NOTE: Evaluates the hoisted equations (see equation_spec::Hoisted) once for every instance, and stores the values in RunState->AllCurResultsBase, which BeginModelRun points to RunState->HoistedValues for this pass.
+INNER_LOOP_BODY(HoistedValueSetupInnerLoop)
+{
+	const mobius_model *Model = DataSet->Model;
+	
+	if(CurrentLevel >= 0)
+		ReadIterationData(DataSet, RunState, BatchGroup.IterationData[CurrentLevel]);
+	else
+	{
+		for(equation_h Result : BatchGroup.LastResultsToReadAtBase)
+		{
+			size_t Offset = *RunState->AtLastResultLookup;
+			++RunState->AtLastResultLookup;
+			RunState->LastResults[Result.Handle] = RunState->AllLastResultsBase[Offset];
+		}
+	}
+	
+	s32 BottomLevel = (s32)BatchGroup.IndexSets.Count - 1;
+	if(CurrentLevel == BottomLevel)
+	{
+		for(size_t BatchIdx = BatchGroup.FirstBatch; BatchIdx <= BatchGroup.LastBatch; ++BatchIdx)
+		{
+			const equation_batch &Batch = Model->EquationBatches[BatchIdx];
+			
+			if(IsValid(Batch.Solver) || (IsValid(Batch.ConditionalSwitch) && Batch.ConditionalValue != RunState->CurParameters[Batch.ConditionalSwitch.Handle]))
+			{
+				RunState->AtResult += Batch.Equations.Count;
+				RunState->AtResult += Batch.EquationsODE.Count;
+				continue;
+			}
+			
+			for(equation_h Equation : Batch.Equations)
+			{
+				if(RunState->HoistedThisRun[Equation.Handle])
+				{
+					RunState->ReadTime = false;
+					double ResultValue = Model->EquationBodies[Equation.Handle](RunState);
+					*RunState->AtResult = ResultValue;
+					RunState->CurResults[Equation.Handle] = ResultValue;
+					//NOTE: The dependency registration can miss a read of the time if it only happens for some parameter values. Such an equation is evaluated every timestep in this run instead.
+					if(RunState->ReadTime) RunState->HoistedThisRun[Equation.Handle] = false;
+				}
+				++RunState->AtResult;
+			}
+		}
+	}
+}
+
+inline void
+ExecutePlanOp(mobius_data_set *DataSet, model_run_state *RunState, const execution_plan &Plan, const execution_plan_op &Op)
+{
+	const mobius_model *Model = DataSet->Model;
+	const equation_batch_group &BatchGroup = Model->BatchGroups[Op.BatchGroup];
+	
+	switch(Op.Type)
+	{
+		case PlanOp_EnterLevel:
+		{
+			index_set_h IndexSet = BatchGroup.IndexSets[Op.Level];
+			RunState->CurrentIndexes[IndexSet.Handle] = index_t(IndexSet, Op.Value);
+			
+			ReadIterationData(DataSet, RunState, BatchGroup.IterationData[Op.Level]);
+#if MOBIUS_TIMESTEP_VERBOSITY >= 2
+			for(size_t Lev = 0; Lev < Op.Level; ++Lev) std::cout << "\t";
+			std::cout << "*** " << GetName(Model, IndexSet) << ": " << DataSet->IndexNames[IndexSet.Handle][Op.Value] << std::endl;
+#endif
+		} break;
+		
+		case PlanOp_ExitLevel:
+		{
+			index_set_h IndexSet = BatchGroup.IndexSets[Op.Level];
+			RunState->CurrentIndexes[IndexSet.Handle] = {IndexSet, 0};
+		} break;
+		
+		case PlanOp_ReadBase:
+		{
+			for(equation_h Result : BatchGroup.LastResultsToReadAtBase)
+			{
+				size_t Offset = *RunState->AtLastResultLookup;
+				++RunState->AtLastResultLookup;
+				RunState->LastResults[Result.Handle] = RunState->AllLastResultsBase[Offset];
+			}
+		} break;
+		
+		case PlanOp_ReadLastResults:
+		{
+			for(equation_h Equation : Plan.GroupEquations[Op.BatchGroup])
+			{
+				RunState->LastResults[Equation.Handle] = *RunState->AtLastResult;
+				++RunState->AtLastResult;
+			}
+		} break;
+		
+		case PlanOp_EvaluateBatch:
+		{
+			const equation_batch &Batch = Model->EquationBatches[Op.Value];
+			for(equation_h Equation : Batch.Equations)
+			{
+				double ResultValue = CallEquation(Model, RunState, Equation);
+#if MOBIUS_TEST_FOR_NAN
+				NaNTest(Model, RunState, ResultValue, Equation);
+#endif
+				*RunState->AtResult = ResultValue;
+				++RunState->AtResult;
+				RunState->CurResults[Equation.Handle] = ResultValue;
+#if MOBIUS_TIMESTEP_VERBOSITY >= 3
+				for(size_t Lev = 0; Lev < Op.Level; ++Lev) std::cout << "\t";
+				std::cout << "\t" << GetName(Model, Equation) << " = " << ResultValue << std::endl;
+#endif
+			}
+		} break;
+		
+		case PlanOp_SolveBatch:
+		{
+			SolveBatch(Model, RunState, Model->EquationBatches[Op.Value], (s32)Op.Level);
+		} break;
+		
+		case PlanOp_SkipResults:
+		{
+			RunState->AtResult += Op.Value;
+		} break;
+	}
+}
+
+static void
+RunExecutionPlan(mobius_data_set *DataSet, model_run_state *RunState, const execution_plan &Plan)
+{
+	if(RunState->Profile && !Plan.Ops.empty())
+	{
+		//NOTE: The ops of one batch group are contiguous in the plan, so we only have to read the clock when the batch group changes.
+		run_profile *Profile = RunState->Profile;
+		u32 BatchGroupIdx = Plan.Ops[0].BatchGroup;
+		u64 Begin = __rdtsc();
+		for(const execution_plan_op &Op : Plan.Ops)
+		{
+			if(Op.BatchGroup != BatchGroupIdx)
+			{
+				u64 End = __rdtsc();
+				Profile->BatchGroupHits[BatchGroupIdx]++;
+				Profile->BatchGroupCycles[BatchGroupIdx] += (End - Begin);
+				BatchGroupIdx = Op.BatchGroup;
+				Begin = End;
+			}
+			ExecutePlanOp(DataSet, RunState, Plan, Op);
+		}
+		Profile->BatchGroupHits[BatchGroupIdx]++;
+		Profile->BatchGroupCycles[BatchGroupIdx] += (__rdtsc() - Begin);
+		return;
+	}
+	
+	for(const execution_plan_op &Op : Plan.Ops)
+		ExecutePlanOp(DataSet, RunState, Plan, Op);
+}
+
+#if !defined(MOBIUS_PARALLEL_INSTANCES)
+#define MOBIUS_PARALLEL_INSTANCES 0
+#endif
+
+#if MOBIUS_PARALLEL_INSTANCES
+
+//NOTE: Multithreaded execution of the instances of a batch group. It has to be compiled with OpenMP (-fopenmp) and MOBIUS_PARALLEL_INSTANCES 1. The number of threads is controlled by the usual OpenMP mechanisms (omp_set_num_threads, OMP_NUM_THREADS).
+//For batch groups where InstancesAreIndependent is set (see EndModelDefinition), the instances of the top index set of the batch group (e.g. each Reach or each Landscape unit) are distributed over the threads. Each thread has its own model_run_state. Every instance reads and writes its own part of the lookup arrays and of ResultData, so no merging is needed, and the results are identical to the serial run.
+//NOTE: Results from equations that use SET_RESULT to write to other instances, or that use random numbers, are not guaranteed to be the same as in a serial run.
+
+struct instance_cursor
+{
+	size_t ParameterLookup;
+	size_t InputLookup;
+	size_t ResultLookup;
+	size_t LastResultLookup;
+	size_t Result;          //NOTE: Relative to the start of the timestep in the result storage.
+};
+
+struct parallel_instances_setup
+{
+	std::vector<model_run_state *> Workers;
+	
+	std::vector<instance_cursor> GroupStart;       //NOTE: Where the first instance of each batch group reads from.
+	std::vector<instance_cursor> InstanceStride;   //NOTE: How far each instance of the top index set of the batch group moves the cursors.
+	
+	std::vector<std::vector<std::vector<u32>>> Wavefronts; //NOTE: For batch groups where InstancesFollowBranches is set: Wavefronts[BatchGroupIdx][Level] are the indexes of the top index set that only have inputs in earlier levels.
+	
+	std::vector<run_profile> WorkerProfiles;   //NOTE: If the run is profiled, each worker collects its timing information here, and it is added to the profile of the run in FreeParallelInstances.
+};
+
+static void
+SetupParallelInstances(mobius_data_set *DataSet, parallel_instances_setup *Setup, size_t SolverTempX0Size, size_t SolverTempWorkSpace, size_t JacobianTempWorkSpace, bool Profiling)
+{
+	const mobius_model *Model = DataSet->Model;
+	
+	Setup->GroupStart.resize(Model->BatchGroups.Count);
+	Setup->InstanceStride.resize(Model->BatchGroups.Count);
+	
+	//NOTE: This mirrors how FastLookupSetupInnerLoop lays out the lookup arrays when it is called through ModelLoop. Every instance of the top index set has the same amount of entries.
+	instance_cursor At = {};
+	size_t BatchGroupIdx = 0;
+	for(const equation_batch_group &BatchGroup : Model->BatchGroups)
+	{
+		instance_cursor Stride = {};
+		At.Result = DataSet->ResultStorageStructure.OffsetForUnit[BatchGroupIdx];
+		Setup->GroupStart[BatchGroupIdx] = At;
+		
+		if(BatchGroup.IndexSets.Count == 0)
+		{
+			At.LastResultLookup += BatchGroup.LastResultsToReadAtBase.Count;
+		}
+		else
+		{
+			size_t Visits = 1;
+			for(size_t Level = 0; Level < BatchGroup.IndexSets.Count; ++Level)
+			{
+				if(Level > 0) Visits *= DataSet->IndexCounts[BatchGroup.IndexSets[Level].Handle];
+				const iteration_data &IterationData = BatchGroup.IterationData[Level];
+				Stride.ParameterLookup  += Visits * IterationData.ParametersToRead.Count;
+				Stride.InputLookup      += Visits * IterationData.InputsToRead.Count;
+				Stride.ResultLookup     += Visits * IterationData.ResultsToRead.Count;
+				Stride.LastResultLookup += Visits * IterationData.LastResultsToRead.Count;
+			}
+			size_t TopCount = DataSet->IndexCounts[BatchGroup.IndexSets[0].Handle];
+			Stride.Result = DataSet->ResultStorageStructure.TotalCountForUnit[BatchGroupIdx] / TopCount;
+			
+			At.ParameterLookup  += TopCount * Stride.ParameterLookup;
+			At.InputLookup      += TopCount * Stride.InputLookup;
+			At.ResultLookup     += TopCount * Stride.ResultLookup;
+			At.LastResultLookup += TopCount * Stride.LastResultLookup;
+		}
+		
+		Setup->InstanceStride[BatchGroupIdx] = Stride;
+		++BatchGroupIdx;
+	}
+	
+	Setup->Wavefronts.clear();
+	Setup->Wavefronts.resize(Model->BatchGroups.Count);
+	BatchGroupIdx = 0;
+	for(const equation_batch_group &BatchGroup : Model->BatchGroups)
+	{
+		if(BatchGroup.InstancesFollowBranches)
+		{
+			index_set_h IndexSet = BatchGroup.IndexSets[0];
+			std::vector<std::vector<u32>> &Wavefronts = Setup->Wavefronts[BatchGroupIdx];
+			
+			//NOTE: SetBranchIndexes requires inputs to be declared before the branches they flow into, so the level of each input is known when we get to the branch.
+			std::vector<size_t> Level(DataSet->IndexCounts[IndexSet.Handle]);
+			for(index_t Index = {IndexSet, 0}; Index < DataSet->IndexCounts[IndexSet.Handle]; ++Index)
+			{
+				Level[Index] = 0;
+				const array<index_t> &Inputs = DataSet->BranchInputs[IndexSet.Handle][Index];
+				for(index_t Input : Inputs)
+					Level[Index] = Max(Level[Index], Level[Input] + 1);
+				
+				if(Wavefronts.size() <= Level[Index]) Wavefronts.resize(Level[Index] + 1);
+				Wavefronts[Level[Index]].push_back(Index.Index);
+			}
+		}
+		++BatchGroupIdx;
+	}
+	
+	size_t NumWorkers = (size_t)omp_get_max_threads();
+	Setup->Workers.resize(NumWorkers);
+	Setup->WorkerProfiles.resize(Profiling ? NumWorkers : 0);
+	for(size_t WorkerIdx = 0; WorkerIdx < NumWorkers; ++WorkerIdx)
+	{
+		model_run_state *Worker = new model_run_state(DataSet);
+		Worker->SolverTempX0          = Worker->BucketMemory.Allocate<double>(SolverTempX0Size);
+		Worker->SolverTempWorkStorage = Worker->BucketMemory.Allocate<double>(SolverTempWorkSpace);
+		Worker->JacobianTempStorage   = Worker->BucketMemory.Allocate<double>(JacobianTempWorkSpace);
+		if(Profiling)
+		{
+			ClearRunProfile(Model, &Setup->WorkerProfiles[WorkerIdx]);
+			Worker->Profile = &Setup->WorkerProfiles[WorkerIdx];
+		}
+		Setup->Workers[WorkerIdx] = Worker;
+	}
+}
+
+static void
+FreeParallelInstances(model_run_state *RunState, parallel_instances_setup *Setup)
+{
+	for(model_run_state *Worker : Setup->Workers)
+	{
+		if(Worker->Profile && RunState->Profile)
+		{
+			for(size_t Idx = 0; Idx < RunState->Profile->EquationHits.size(); ++Idx)
+			{
+				RunState->Profile->EquationHits[Idx]   += Worker->Profile->EquationHits[Idx];
+				RunState->Profile->EquationCycles[Idx] += Worker->Profile->EquationCycles[Idx];
+			}
+			for(size_t Idx = 0; Idx < RunState->Profile->SolverHits.size(); ++Idx)
+			{
+				RunState->Profile->SolverHits[Idx]        += Worker->Profile->SolverHits[Idx];
+				RunState->Profile->SolverCycles[Idx]      += Worker->Profile->SolverCycles[Idx];
+				RunState->Profile->SolverEvaluations[Idx] += Worker->Profile->SolverEvaluations[Idx];
+			}
+		}
+		RunState->DrewRandomNumbers = RunState->DrewRandomNumbers || Worker->DrewRandomNumbers;
+		RunState->MaxStepBack = Max(RunState->MaxStepBack, Worker->MaxStepBack);
+		delete Worker;
+	}
+	Setup->Workers.clear();
+	Setup->WorkerProfiles.clear();
+}
+
+inline void
+SetInstanceCursor(model_run_state *RunState, const instance_cursor &Start, const instance_cursor &Stride, size_t Instance)
+{
+	RunState->AtParameterLookup  = RunState->FastParameterLookup.Data  + Start.ParameterLookup  + Instance*Stride.ParameterLookup;
+	RunState->AtInputLookup      = RunState->FastInputLookup.Data      + Start.InputLookup      + Instance*Stride.InputLookup;
+	RunState->AtResultLookup     = RunState->FastResultLookup.Data     + Start.ResultLookup     + Instance*Stride.ResultLookup;
+	RunState->AtLastResultLookup = RunState->FastLastResultLookup.Data + Start.LastResultLookup + Instance*Stride.LastResultLookup;
+	RunState->AtResult           = RunState->AllCurResultsBase  + Start.Result + Instance*Stride.Result;
+	RunState->AtLastResult       = RunState->AllLastResultsBase + Start.Result + Instance*Stride.Result;
+}
+
+static void
+RunInnerLoopSubtree(mobius_data_set *DataSet, model_run_state *RunState, const equation_batch_group &BatchGroup, size_t BatchGroupIdx, s32 CurrentLevel)
+{
+	//NOTE: Visits the index sets below CurrentLevel in the same order as ModelLoop does.
+	index_set_h IndexSet = BatchGroup.IndexSets[CurrentLevel];
+	s32 BottomLevel = (s32)BatchGroup.IndexSets.Count - 1;
+	for(index_t Index = {IndexSet, 0}; Index < DataSet->IndexCounts[IndexSet.Handle]; ++Index)
+	{
+		RunState->CurrentIndexes[IndexSet.Handle] = Index;
+		RunInnerLoop(DataSet, RunState, BatchGroup, BatchGroupIdx, CurrentLevel);
+		if(CurrentLevel != BottomLevel)
+			RunInnerLoopSubtree(DataSet, RunState, BatchGroup, BatchGroupIdx, CurrentLevel + 1);
+	}
+	RunState->CurrentIndexes[IndexSet.Handle] = {IndexSet, 0};
+}
+
+inline void
+SyncWorker(model_run_state *Worker, model_run_state *RunState)
+{
+	const mobius_model *Model = RunState->Model;
+	
+	//NOTE: Results of batch groups without index sets, as well as parameters and inputs without index sets, are only kept in the Cur-buffers of the main run state, so the workers need a copy of those.
+	memcpy(Worker->CurParameters,       RunState->CurParameters,       sizeof(parameter_value)*Model->Parameters.Count());
+	memcpy(Worker->CurInputs,           RunState->CurInputs,           sizeof(double)*Model->Inputs.Count());
+	memcpy(Worker->CurInputWasProvided, RunState->CurInputWasProvided, sizeof(bool)*Model->Inputs.Count());
+	memcpy(Worker->CurResults,          RunState->CurResults,          sizeof(double)*Model->Equations.Count());
+	memcpy(Worker->LastResults,         RunState->LastResults,         sizeof(double)*Model->Equations.Count());
+	
+	Worker->Timestep             = RunState->Timestep;
+	Worker->CurrentTime          = RunState->CurrentTime;
+	Worker->RandomKey[0]         = RunState->RandomKey[0];
+	Worker->RandomKey[1]         = RunState->RandomKey[1];
+	Worker->AllCurResultsBase    = RunState->AllCurResultsBase;
+	Worker->AllLastResultsBase   = RunState->AllLastResultsBase;
+	Worker->AllCurInputsBase     = RunState->AllCurInputsBase;
+	Worker->FastParameterLookup  = RunState->FastParameterLookup;
+	Worker->FastInputLookup      = RunState->FastInputLookup;
+	Worker->FastResultLookup     = RunState->FastResultLookup;
+	Worker->FastLastResultLookup = RunState->FastLastResultLookup;
+	Worker->EquationBodies       = RunState->EquationBodies;
+	Worker->HoistedValues        = RunState->HoistedValues;
+}
+
+inline void
+RunInstance(mobius_data_set *DataSet, model_run_state *Worker, const equation_batch_group &BatchGroup, size_t BatchGroupIdx, const instance_cursor &Start, const instance_cursor &Stride, u32 Instance)
+{
+	index_set_h TopIndexSet = BatchGroup.IndexSets[0];
+	SetInstanceCursor(Worker, Start, Stride, Instance);
+	Worker->CurrentIndexes[TopIndexSet.Handle] = index_t(TopIndexSet, Instance);
+	RunInnerLoop(DataSet, Worker, BatchGroup, BatchGroupIdx, 0);
+	if(BatchGroup.IndexSets.Count > 1)
+		RunInnerLoopSubtree(DataSet, Worker, BatchGroup, BatchGroupIdx, 1);
+	Worker->CurrentIndexes[TopIndexSet.Handle] = {TopIndexSet, 0};
+}
+
+static void
+ParallelModelLoop(mobius_data_set *DataSet, model_run_state *RunState, parallel_instances_setup *Setup)
+{
+	const mobius_model *Model = DataSet->Model;
+	
+	size_t BatchGroupIdx = 0;
+	for(const equation_batch_group &BatchGroup : Model->BatchGroups)
+	{
+		const instance_cursor &Start  = Setup->GroupStart[BatchGroupIdx];
+		const instance_cursor &Stride = Setup->InstanceStride[BatchGroupIdx];
+		const std::vector<std::vector<u32>> &Wavefronts = Setup->Wavefronts[BatchGroupIdx];
+		
+		s64 TopCount = BatchGroup.IndexSets.Count ? (s64)DataSet->IndexCounts[BatchGroup.IndexSets[0].Handle].Index : 0;
+		
+		u64 Begin = RunState->Profile ? __rdtsc() : 0;
+		
+		if(BatchGroup.InstancesAreIndependent && TopCount > 1 && Setup->Workers.size() > 1)
+		{
+			#pragma omp parallel
+			{
+				model_run_state *Worker = Setup->Workers[omp_get_thread_num()];
+				SyncWorker(Worker, RunState);
+				
+				#pragma omp for schedule(static)
+				for(s64 Instance = 0; Instance < TopCount; ++Instance)
+					RunInstance(DataSet, Worker, BatchGroup, BatchGroupIdx, Start, Stride, (u32)Instance);
+			}
+		}
+		else if(!Wavefronts.empty() && Wavefronts.size() < (size_t)TopCount && Setup->Workers.size() > 1)
+		{
+			#pragma omp parallel
+			{
+				model_run_state *Worker = Setup->Workers[omp_get_thread_num()];
+				SyncWorker(Worker, RunState);
+				
+				//NOTE: The implicit barrier at the end of each omp for makes sure that all the branches of one wavefront are finished before any of the branches downstream of them start.
+				for(const std::vector<u32> &Wavefront : Wavefronts)
+				{
+					s64 WavefrontCount = (s64)Wavefront.size();
+					#pragma omp for schedule(dynamic)
+					for(s64 Idx = 0; Idx < WavefrontCount; ++Idx)
+						RunInstance(DataSet, Worker, BatchGroup, BatchGroupIdx, Start, Stride, Wavefront[Idx]);
+				}
+			}
+		}
+		else
+		{
+			SetInstanceCursor(RunState, Start, Stride, 0);
+			ModelLoopBatchGroup(DataSet, RunState, RunInnerLoop, BatchGroup, BatchGroupIdx);
+		}
+		
+		if(RunState->Profile)
+		{
+			RunState->Profile->BatchGroupHits[BatchGroupIdx]++;
+			RunState->Profile->BatchGroupCycles[BatchGroupIdx] += (__rdtsc() - Begin);
+		}
+		
+		++BatchGroupIdx;
+	}
+}
+
+#endif //MOBIUS_PARALLEL_INSTANCES
+
+
+inline double
+SetupInitialValue(mobius_data_set *DataSet, model_run_state *RunState, equation_h Equation)
+{
+	const mobius_model *Model = DataSet->Model;
+	const equation_spec &Spec = Model->Equations[Equation];
+	
+	double Initial = 0.0;
+	if(IsValid(Spec.InitialValue))
+	{
+		size_t Offset = OffsetForHandle(DataSet->ParameterStorageStructure, RunState->CurrentIndexes, DataSet->IndexCounts, (parameter_h)Spec.InitialValue);
+		//NOTE: We should not get a type mismatch here since we only allow for registering initial values using handles of type parameter_double_h. Thus we do not need to test for which type it is.
+		Initial = DataSet->ParameterData[Offset].ValDouble;
+	}
+	else if(Spec.HasExplicitInitialValue)
+		Initial = Spec.ExplicitInitialValue;
+	else if(IsValid(Spec.InitialValueEquation))
+		Initial = Model->EquationBodies[Spec.InitialValueEquation.Handle](RunState);
+	else
+		//NOTE: Equations without any type of initial value act as their own initial value equation
+		Initial = Model->EquationBodies[Equation.Handle](RunState);
+	
+	size_t ResultStorageLocation = DataSet->ResultStorageStructure.LocationOfHandleInUnit[Equation.Handle];
+	
+#if MOBIUS_TEST_FOR_NAN
+	NaNTest(Model, RunState, Initial, Equation);
+#endif
+	
+	RunState->AtResult[ResultStorageLocation] = Initial;
+	RunState->CurResults[Equation.Handle] = Initial;
+	RunState->LastResults[Equation.Handle] = Initial;
+	
+	return Initial;
+}
+
+INNER_LOOP_BODY(InitialValueSetupInnerLoop)
+{
+	// TODO: IMPORTANT!! If an initial value equation depends on the result of an equation from a different batch group than itself, that is not guaranteed to work correctly.
+	// TODO: Currently we don't report an error if that happens!
+	
+	const mobius_model *Model = DataSet->Model;
+	
+	if(CurrentLevel >= 0)
+	{
+		for(parameter_h Parameter : BatchGroup.IterationData[CurrentLevel].ParametersToRead)
+		{
+			RunState->CurParameters[Parameter.Handle] = *RunState->AtParameterLookup;
+			++RunState->AtParameterLookup;
+		}
+		for(input_h Input : BatchGroup.IterationData[CurrentLevel].InputsToRead)
+		{
+			size_t Offset = *RunState->AtInputLookup;
+			++RunState->AtInputLookup;
+			RunState->CurInputs[Input.Handle] = RunState->AllCurInputsBase[Offset];
+			RunState->CurInputWasProvided[Input.Handle] = DataSet->InputTimeseriesWasProvided[Offset];
+		}
+	}
+
+#if MOBIUS_TIMESTEP_VERBOSITY >= 2
+	if(CurrentLevel >= 0)
+	{
+		index_set_h CurrentIndexSet = BatchGroup.IndexSets[CurrentLevel];
+		for(int Lev = 0; Lev < CurrentLevel; ++Lev) std::cout << "\t";
+		index_t CurrentIndex = RunState->CurrentIndexes[CurrentIndexSet.Handle];
+		std::cout << "*** " << GetName(Model, CurrentIndexSet) << ": " << DataSet->IndexNames[CurrentIndexSet.Handle][CurrentIndex] << std::endl;
+	}
+#endif
+	
+	s32 BottomLevel = BatchGroup.IndexSets.Count - 1;
+	if(CurrentLevel == BottomLevel)
 	{	
 		for(equation_h Equation : BatchGroup.InitialValueOrder)
 		{
@@ -1749,18 +2448,162 @@ ProcessComputedParameters(mobius_data_set *DataSet, model_run_state *RunState)
 	}
 }
 
+//NOTE: The run context keeps the parts of the run setup that only depend on the model and the index structure of the data set between calls to RunModel, so that repeated runs (e.g. during calibration, where typically only parameter values change) don't have to redo them. It is created on the first run of a data set and freed together with the data set. It is not copied by CopyDataSet.
+struct mobius_run_context
+{
+	model_run_state RunState;     //NOTE: Owns the fast lookup arrays and the solver work storage.
+	
+	execution_plan ExecutionPlan;
+	
+#if MOBIUS_PARALLEL_INSTANCES
+	parallel_instances_setup ParallelSetup;   //NOTE: Only valid between BeginModelRun and EndModelRun.
+#endif
+	
+	std::vector<size_t>          SwitchOffsets;  //NOTE: The location in ParameterData of every instance of every parameter that is used as a conditional switch.
+	std::vector<parameter_value> SwitchValues;   //NOTE: The values of these during the previous run.
+	
+	timer RunTimer;       //NOTE: When the timesteps of a profiled run started.
+	u64   RunBeginCycles;
+	
+	mobius_run_context(mobius_data_set *DataSet) : RunState(DataSet) {}
+};
+
+static void
+FreeRunContext(mobius_run_context *Context)
+{
+	delete Context;
+}
+
+static bool
+UpdateConditionalSwitches(mobius_data_set *DataSet, mobius_run_context *Context)
+{
+	//NOTE: Returns true if the value of any conditional switch parameter changed since the previous run. This decides which results are left untouched by the run, and so whether or not the result data has to be cleared and the execution plan rebuilt.
+	const mobius_model *Model = DataSet->Model;
+	
+	if(Context->SwitchOffsets.empty())
+	{
+		std::set<parameter_h> Switches;
+		for(const equation_batch &Batch : Model->EquationBatches)
+		{
+			if(IsValid(Batch.ConditionalSwitch)) Switches.insert(Batch.ConditionalSwitch);
+		}
+		for(parameter_h Switch : Switches)
+		{
+			ForeachParameterInstance(DataSet, Switch, [DataSet, Switch, Context](index_t *Indexes, size_t IndexesCount)
+			{
+				Context->SwitchOffsets.push_back(OffsetForHandle(DataSet->ParameterStorageStructure, Indexes, IndexesCount, DataSet->IndexCounts, Switch));
+			});
+		}
+		Context->SwitchValues.resize(Context->SwitchOffsets.size());
+	}
+	
+	bool Changed = false;
+	for(size_t Idx = 0; Idx < Context->SwitchOffsets.size(); ++Idx)
+	{
+		parameter_value Value = DataSet->ParameterData[Context->SwitchOffsets[Idx]];
+		if(Value != Context->SwitchValues[Idx]) Changed = true;
+		Context->SwitchValues[Idx] = Value;
+	}
+	return Changed;
+}
+
+static void
+PrintRunProfile(mobius_data_set *DataSet);
+
+//NOTE: A model run is split into BeginModelRun, which does the setup and computes the initial values, one call to RunModelTimestep per timestep, and EndModelRun. RunModel does all of these for one data set. It also runs again if an EARLIER_RESULT read further back than the result window, which other callers of these functions have to check for themselves (RunState.MaxStepBack > 0 after EndModelRun).
+
+//NOTE: For IncrementalRuns. Returns the first timestep of the coming run whose inputs differ from the last run, or 0 if the parameters differ or the last run is not known.
+static u64
+FirstChangedTimestep(mobius_data_set *DataSet, s64 InputDataStartOffsetTimesteps, u64 Timesteps)
+{
+	size_t ParameterCount = DataSet->ParameterStorageStructure.TotalCount;
+	if(DataSet->ParameterDataLastRun.size() != ParameterCount || memcmp(DataSet->ParameterDataLastRun.data(), DataSet->ParameterData, sizeof(parameter_value)*ParameterCount) != 0)
+		return 0;
+	
+	size_t InputCount = DataSet->InputStorageStructure.TotalCount;
+	if(DataSet->InputDataLastRun.size() != InputCount*DataSet->InputDataTimesteps || DataSet->InputWasProvidedLastRun.size() != InputCount)
+		return 0;
+	for(size_t Offset = 0; Offset < InputCount; ++Offset)
+	{
+		if(DataSet->InputWasProvidedLastRun[Offset] != (u8)DataSet->InputTimeseriesWasProvided[Offset]) return 0;
+	}
+	
+	//NOTE: The initial value equations read the inputs of the timestep before the start date, if there is one.
+	s64 FirstInputTimestep = InputDataStartOffsetTimesteps > 0 ? InputDataStartOffsetTimesteps - 1 : 0;
+	for(s64 InputTimestep = FirstInputTimestep; InputTimestep < InputDataStartOffsetTimesteps + (s64)Timesteps; ++InputTimestep)
+	{
+		size_t Offset = (size_t)InputTimestep*InputCount;
+		if(memcmp(DataSet->InputData + Offset, DataSet->InputDataLastRun.data() + Offset, sizeof(double)*InputCount) != 0)
+			return (u64)Max(InputTimestep - InputDataStartOffsetTimesteps, (s64)0);
+	}
+	
+	return Timesteps;
+}
+
 static void
-PrintEquationProfiles(mobius_data_set *DataSet, model_run_state *RunState);
+SaveIncrementalRunState(mobius_data_set *DataSet)
+{
+	size_t InputCount = DataSet->InputStorageStructure.TotalCount;
+	DataSet->ParameterDataLastRun.assign(DataSet->ParameterData, DataSet->ParameterData + DataSet->ParameterStorageStructure.TotalCount);
+	DataSet->InputDataLastRun.assign(DataSet->InputData, DataSet->InputData + InputCount*DataSet->InputDataTimesteps);
+	DataSet->InputWasProvidedLastRun.assign(DataSet->InputTimeseriesWasProvided, DataSet->InputTimeseriesWasProvided + InputCount);
+}
 
 static void
-RunModel(mobius_data_set *DataSet)
+ResetStreamingObjectives(mobius_data_set *DataSet)
 {
-#if MOBIUS_PRINT_TIMING_INFO
-	timer SetupTimer = BeginTimer();
-#endif
+	for(streaming_objective &Objective : DataSet->StreamingObjectives)
+	{
+		Objective.Count                       = 0;
+		Objective.SumAbsResidual              = 0.0;
+		Objective.SumSquaredResidual          = 0.0;
+		Objective.MeanObserved                = 0.0;
+		Objective.SumSquaredDeviationObserved = 0.0;
+		Objective.SumLogAbsModeled            = 0.0;
+		Objective.SumSquaredRelativeResidual  = 0.0;
+		Objective.Exceeded                    = false;
+	}
+	DataSet->RunWasStopped = false;
+}
+
+//NOTE: Add the current timestep to the streaming objectives. Has to be called after the results of the timestep are computed, and before RunState moves on to the next timestep.
+inline void
+AccumulateStreamingObjectives(mobius_data_set *DataSet, model_run_state &RunState)
+{
+	for(streaming_objective &Objective : DataSet->StreamingObjectives)
+	{
+		if((u64)RunState.Timestep < Objective.DiscardTimesteps) continue;
+		
+		double Modeled  = RunState.AllCurResultsBase[Objective.ResultOffset];
+		double Observed = RunState.AllCurInputsBase[Objective.InputOffset];
+		double Residual = Modeled - Observed;
+		if(std::isnan(Residual)) continue;
+		
+		++Objective.Count;
+		Objective.SumAbsResidual     += std::abs(Residual);
+		Objective.SumSquaredResidual += Residual*Residual;
+		double Deviation = Observed - Objective.MeanObserved;
+		Objective.MeanObserved += Deviation / (double)Objective.Count;
+		Objective.SumSquaredDeviationObserved += Deviation*(Observed - Objective.MeanObserved);
+		Objective.SumLogAbsModeled           += std::log(std::abs(Modeled));
+		Objective.SumSquaredRelativeResidual += (Residual/Modeled)*(Residual/Modeled);
+		
+		if(Objective.SumAbsResidual > Objective.MaxSumAbsResidual || Objective.SumSquaredResidual > Objective.MaxSumSquaredResidual)
+		{
+			Objective.Exceeded = true;
+			DataSet->RunWasStopped = true;
+		}
+	}
+}
 
+static void
+BeginModelRun(mobius_data_set *DataSet, bool KeepAllTimesteps = false)
+{
 	const mobius_model *Model = DataSet->Model;
 	
+	timer SetupTimer = BeginTimer();
+	u64 SetupBeginCycles = __rdtsc();
+	
 	//NOTE: Check that all the index sets have at least one index.
 	for(index_set_h IndexSet : Model->IndexSets)
 	{
@@ -1843,7 +2686,31 @@ RunModel(mobius_data_set *DataSet)
 	if(((s64)DataSet->InputDataTimesteps - InputDataStartOffsetTimesteps) < (s64)Timesteps)
 		FatalError("ERROR: The input data provided has fewer timesteps (after the model run start date) than the number of timesteps the model is running for.\n");
 	
-	AllocateResultStorage(DataSet, Timesteps);
+	//NOTE: An incremental run can only reuse the results of the last run if they are all still stored.
+	bool ResultsOfLastRunKept = DataSet->IncrementalRuns && DataSet->HasBeenRun && DataSet->TimestepsLastRun == Timesteps
+		&& DataSet->StartDateLastRun.SecondsSinceEpoch == ModelStartTime.SecondsSinceEpoch && DataSet->ResultDataTimesteps == Timesteps;
+	double *ResultDataLastRun = DataSet->ResultData;
+	
+	bool ReusingContext = (DataSet->RunContext != nullptr);
+	if(!ReusingContext)
+		DataSet->RunContext = new mobius_run_context(DataSet);
+	mobius_run_context *Context = DataSet->RunContext;
+	model_run_state &RunState = Context->RunState;
+	
+	//NOTE: The random key has to be set before the computed parameters are processed, since the equations that compute them can draw random numbers. These draws are made as if at the timestep before the first one, like the draws of the initial value equations.
+	u64 RandomKey = DataSet->HasRandomSeed ? MixBits64(DataSet->RandomSeed ^ MixBits64(DataSet->RandomStream + 0x9E3779B97F4A7C15ull)) : GenerateRunSeed();
+	bool RandomKeyChanged = RunState.DrewRandomNumbers && RandomKey != RunState.GetRandomKey();  //NOTE: If so, an incremental run can not reuse the results of the last run.
+	RunState.SetRandomKey(RandomKey);
+	RunState.Timestep = -1;
+	
+	ProcessComputedParameters(DataSet, &RunState);
+	
+	RunState.Clear();
+	
+	//NOTE: Every result is overwritten during the run except the ones of batches that are turned off by conditional switches. If those are turned off in the same places as in the previous run, they still have the value 0, and we don't need to clear the result data.
+	bool SwitchesChanged = UpdateConditionalSwitches(DataSet, Context);
+	
+	AllocateResultStorage(DataSet, Timesteps, !ReusingContext || SwitchesChanged, KeepAllTimesteps);
 	
 	//NOTE: The following have to be set here, because in case there is an error later, TimestepsLastRun must have been recorded correctly.
 	//TODO: Maybe we should have a separate number that denotes the size of the ResultData allocation just to be safe.
@@ -1852,16 +2719,17 @@ RunModel(mobius_data_set *DataSet)
 	DataSet->StartDateLastRun = ModelStartTime;
 	
 	
-	model_run_state RunState(DataSet);
-	
-	ProcessComputedParameters(DataSet, &RunState);
-	
-	RunState.Clear();
-	
-	
 	for(const mobius_preprocessing_step &PreprocessingStep : Model->PreprocessingSteps)
 		PreprocessingStep(DataSet);
 	
+	//NOTE: This has to be done after the preprocessing steps, since they can write to the inputs.
+	u64 FirstTimestep = 0;
+	if(ResultsOfLastRunKept && ReusingContext && !SwitchesChanged && !RandomKeyChanged && DataSet->ResultData == ResultDataLastRun && DataSet->ResultDataTimesteps == Timesteps)
+		FirstTimestep = FirstChangedTimestep(DataSet, InputDataStartOffsetTimesteps, Timesteps);
+	if(FirstTimestep == 0) RunState.DrewRandomNumbers = false;
+	RunState.MaxStepBack = 0;
+	DataSet->ParameterDataLastRun.clear();   //NOTE: Saved again in EndModelRun if the run completes.
+	
 	// Check if solver step size makes sense.
 	for(solver_h Solver: Model->Solvers)
 	{
@@ -1890,23 +2758,32 @@ RunModel(mobius_data_set *DataSet)
 	
 	///////////// Setting up fast lookup ////////////////////
 	
-	//NOTE: This is a hack, where we first set the Count for each array in the FastLookupCounter routine, then allocate, then set it to 0 to use it as an iterator in FastLookupSetupInnerLoop
-	ModelLoop(DataSet, &RunState, FastLookupCounter);
-	RunState.Clear();
+	if(!ReusingContext)
+	{
+		//NOTE: This is a hack, where we first set the Count for each array in the FastLookupCounter routine, then allocate, then set it to 0 to use it as an iterator in FastLookupSetupInnerLoop
+		ModelLoop(DataSet, &RunState, FastLookupCounter);
+		RunState.Clear();
 
-	RunState.FastParameterLookup.Allocate(&RunState.BucketMemory, RunState.FastParameterLookup.Count);
-	RunState.FastInputLookup.Allocate(&RunState.BucketMemory, RunState.FastInputLookup.Count);
-	RunState.FastResultLookup.Allocate(&RunState.BucketMemory, RunState.FastResultLookup.Count);
-	RunState.FastLastResultLookup.Allocate(&RunState.BucketMemory, RunState.FastLastResultLookup.Count);
+		RunState.FastParameterLookup.Allocate(&RunState.BucketMemory, RunState.FastParameterLookup.Count);
+		RunState.FastParameterOffsets.Allocate(&RunState.BucketMemory, RunState.FastParameterLookup.Count);
+		RunState.FastInputLookup.Allocate(&RunState.BucketMemory, RunState.FastInputLookup.Count);
+		RunState.FastResultLookup.Allocate(&RunState.BucketMemory, RunState.FastResultLookup.Count);
+		RunState.FastLastResultLookup.Allocate(&RunState.BucketMemory, RunState.FastLastResultLookup.Count);
 
-	RunState.FastParameterLookup.Count  = 0;
-	RunState.FastInputLookup.Count      = 0;
-	RunState.FastResultLookup.Count     = 0;
-	RunState.FastLastResultLookup.Count = 0;
-	
-	//Technically we really only need to rebuild the parameter lookup, not the three others, but it is very fast anyway.
-	ModelLoop(DataSet, &RunState, FastLookupSetupInnerLoop);
-	RunState.Clear();
+		RunState.FastParameterLookup.Count  = 0;
+		RunState.FastInputLookup.Count      = 0;
+		RunState.FastResultLookup.Count     = 0;
+		RunState.FastLastResultLookup.Count = 0;
+		
+		ModelLoop(DataSet, &RunState, FastLookupSetupInnerLoop);
+		RunState.Clear();
+	}
+	else
+	{
+		//NOTE: The offsets in the input and result lookups only depend on the index structure, which can not change after the first run. Only the parameter values have to be refreshed.
+		for(size_t Idx = 0; Idx < RunState.FastParameterLookup.Count; ++Idx)
+			RunState.FastParameterLookup[Idx] = DataSet->ParameterData[RunState.FastParameterOffsets[Idx]];
+	}
 	
 	//NOTE: Temporary storage for use by solvers:
 	//TODO: This code should probably be a member function of model_run_state or similar.
@@ -1931,9 +2808,23 @@ RunModel(mobius_data_set *DataSet)
 
 	size_t JacobiTempWorkSpace = MaxODECount + MaxNonODECount;
 	
-	RunState.SolverTempX0          = RunState.BucketMemory.Allocate<double>(MaxODECount);
-	RunState.SolverTempWorkStorage = RunState.BucketMemory.Allocate<double>(SolverTempWorkSpace);
-	RunState.JacobianTempStorage   = RunState.BucketMemory.Allocate<double>(JacobiTempWorkSpace);
+	if(!ReusingContext)
+	{
+		bool HasHoistedEquations = false;
+		for(equation_h Equation : Model->Equations)
+			HasHoistedEquations = HasHoistedEquations || Model->Equations[Equation].Hoisted;
+		
+		if(HasHoistedEquations)
+		{
+			RunState.EquationBodies = RunState.BucketMemory.Allocate<mobius_equation>(Model->Equations.Count());
+			RunState.HoistedValues  = RunState.BucketMemory.Allocate<double>(DataSet->ResultStorageStructure.TotalCount);
+			RunState.HoistedThisRun = RunState.BucketMemory.Allocate<bool>(Model->Equations.Count());
+		}
+		
+		RunState.SolverTempX0          = RunState.BucketMemory.Allocate<double>(MaxODECount);
+		RunState.SolverTempWorkStorage = RunState.BucketMemory.Allocate<double>(SolverTempWorkSpace);
+		RunState.JacobianTempStorage   = RunState.BucketMemory.Allocate<double>(JacobiTempWorkSpace);
+	}
 	
 	
 
@@ -1987,61 +2878,221 @@ RunModel(mobius_data_set *DataSet)
 #endif
 	RunState.Timestep = -1;
 	ModelLoop(DataSet, &RunState, InitialValueSetupInnerLoop);
-	//***********
 	
-#if MOBIUS_PRINT_TIMING_INFO
-	u64 SetupDuration = GetTimerMilliseconds(&SetupTimer);
-	timer RunTimer = BeginTimer();
-	u64 BeforeC = __rdtsc();
-#endif
+	if(!DataSet->Restart.Results.empty())
+		ApplyRestartCheckpoint(DataSet, ModelStartTime);
+	//***********
 	
 	RunState.AllLastResultsBase = DataSet->ResultData;
 	RunState.AllCurResultsBase = DataSet->ResultData + DataSet->ResultStorageStructure.TotalCount;
 	RunState.AllCurInputsBase = DataSet->InputData + ((size_t)InputDataStartOffsetTimesteps)*DataSet->InputStorageStructure.TotalCount;
 	
-#if MOBIUS_EQUATION_PROFILING
-	RunState.EquationHits        = RunState.BucketMemory.Allocate<size_t>(Model->Equations.Count());
-	RunState.EquationTotalCycles = RunState.BucketMemory.Allocate<u64>(Model->Equations.Count());
-#endif
-	
-	//TODO: Timesteps is u64. Can cause problems if somebody have an unrealistically high amount of timesteps. Ideally we should move every parameter from u64 to s64 anyway? There is a similar problem a little earlier in this routine.
-	s64 MaxStep = (s64)Timesteps;
-	
-	for(RunState.Timestep = 0; RunState.Timestep < MaxStep; ++RunState.Timestep)
+	RunState.Profile = nullptr;
+	if(DataSet->Profiling || MOBIUS_EQUATION_PROFILING)
 	{
+		ClearRunProfile(Model, &DataSet->Profile);
+		RunState.Profile = &DataSet->Profile;
+	}
+
+	//NOTE: The hoisted equations only depend on parameters, so they are evaluated once here instead of every timestep. During the run, CallHoistedEquation looks their values up in HoistedValues.
+	if(RunState.HoistedValues)
+	{
+		for(equation_h Equation : Model->Equations)
+			RunState.HoistedThisRun[Equation.Handle] = Model->Equations[Equation].Hoisted;
 		
-#if MOBIUS_TIMESTEP_VERBOSITY >= 1
-		std::cout << "Timestep: " << RunState.Timestep << std::endl;
-		//std::cout << "Day of year: " << RunState.DayOfYear << std::endl;
-#endif
-		
-		RunState.AtResult           = RunState.AllCurResultsBase;
+		double *CurResultsBase = RunState.AllCurResultsBase;
+		RunState.AllCurResultsBase  = RunState.HoistedValues;
+		RunState.AtResult           = RunState.HoistedValues;
 		RunState.AtLastResult       = RunState.AllLastResultsBase;
-		
 		RunState.AtParameterLookup  = RunState.FastParameterLookup.Data;
 		RunState.AtInputLookup      = RunState.FastInputLookup.Data;
 		RunState.AtResultLookup     = RunState.FastResultLookup.Data;
 		RunState.AtLastResultLookup = RunState.FastLastResultLookup.Data;
+		ModelLoop(DataSet, &RunState, HoistedValueSetupInnerLoop);
+		RunState.AllCurResultsBase  = CurResultsBase;
 		
-		//NOTE: We have to update the inputs that don't depend on any index sets here, as that is not handled by the "fast lookup system".
-		if(DataSet->InputStorageStructure.Units.Count != 0 && DataSet->InputStorageStructure.Units[0].IndexSets.Count == 0)
+		//NOTE: If an equation turned out to read the time, the hoisted equations that depend on it can not be hoisted in this run either.
+		bool HoistingChanged = true;
+		while(HoistingChanged)
 		{
-			for(input_h Input : DataSet->InputStorageStructure.Units[0].Handles)
+			HoistingChanged = false;
+			for(equation_h Equation : Model->Equations)
 			{
-				size_t Offset = OffsetForHandle(DataSet->InputStorageStructure, Input);
-				RunState.CurInputs[Input.Handle] = RunState.AllCurInputsBase[Offset];
+				if(!RunState.HoistedThisRun[Equation.Handle]) continue;
+				for(equation_h ResultDependency : Model->Equations[Equation].DirectResultDependencies)
+				{
+					if(!RunState.HoistedThisRun[ResultDependency.Handle])
+					{
+						RunState.HoistedThisRun[Equation.Handle] = false;
+						HoistingChanged = true;
+						break;
+					}
+				}
 			}
 		}
 		
-		ModelLoop(DataSet, &RunState, RunInnerLoop);
+		mobius_equation *EquationBodies = (mobius_equation *)RunState.EquationBodies; //NOTE: This is the copy that was allocated above, not Model->EquationBodies.
+		for(equation_h Equation : Model->Equations)
+		{
+			EquationBodies[Equation.Handle] = Model->EquationBodies[Equation.Handle];
+			if(RunState.HoistedThisRun[Equation.Handle])
+				EquationBodies[Equation.Handle] = {CallHoistedEquation, nullptr, nullptr};
+		}
+	}
+	
+	RunState.Timestep = 0;
+	
+	ResetStreamingObjectives(DataSet);
+	
+	//NOTE: In an incremental run, the results before FirstTimestep are kept from the last run. They still count towards the streaming objectives.
+	if(FirstTimestep > 0)
+	{
+		for(u64 Timestep = 0; Timestep < FirstTimestep; ++Timestep)
+		{
+			RunState.Timestep = (s64)Timestep;
+			if(!DataSet->RunWasStopped) AccumulateStreamingObjectives(DataSet, RunState);
+			RunState.AllLastResultsBase += DataSet->ResultStorageStructure.TotalCount;
+			RunState.AllCurResultsBase  += DataSet->ResultStorageStructure.TotalCount;
+			RunState.AllCurInputsBase   += DataSet->InputStorageStructure.TotalCount;
+			RunState.CurrentTime.Advance();
+		}
+		RunState.Timestep = (s64)FirstTimestep;
+	}
+	
+#if MOBIUS_PARALLEL_INSTANCES
+	SetupParallelInstances(DataSet, &Context->ParallelSetup, MaxODECount, SolverTempWorkSpace, JacobiTempWorkSpace, RunState.Profile != nullptr);
+#else
+	//NOTE: The execution plan only depends on the index structure and on the values of the conditional switches.
+	execution_plan &ExecutionPlan = Context->ExecutionPlan;
+	if(ExecutionPlan.Ops.empty() || SwitchesChanged)
+		BuildExecutionPlan(DataSet, &ExecutionPlan);
+#endif
+	
+	if(RunState.Profile)
+	{
+		RunState.Profile->SetupCycles       = __rdtsc() - SetupBeginCycles;
+		RunState.Profile->SetupMilliseconds = GetTimerMilliseconds(&SetupTimer);
+		RunState.Profile->Timesteps         = Timesteps - FirstTimestep;
+		Context->RunTimer       = BeginTimer();
+		Context->RunBeginCycles = __rdtsc();
+	}
+}
+
+inline void
+BeginModelTimestep(mobius_data_set *DataSet, model_run_state &RunState)
+{
+#if MOBIUS_TIMESTEP_VERBOSITY >= 1
+	std::cout << "Timestep: " << RunState.Timestep << std::endl;
+	//std::cout << "Day of year: " << RunState.DayOfYear << std::endl;
+#endif
+	
+	RunState.AtResult           = RunState.AllCurResultsBase;
+	RunState.AtLastResult       = RunState.AllLastResultsBase;
+	
+	RunState.AtParameterLookup  = RunState.FastParameterLookup.Data;
+	RunState.AtInputLookup      = RunState.FastInputLookup.Data;
+	RunState.AtResultLookup     = RunState.FastResultLookup.Data;
+	RunState.AtLastResultLookup = RunState.FastLastResultLookup.Data;
+	
+	//NOTE: We have to update the inputs that don't depend on any index sets here, as that is not handled by the "fast lookup system".
+	if(DataSet->InputStorageStructure.Units.Count != 0 && DataSet->InputStorageStructure.Units[0].IndexSets.Count == 0)
+	{
+		for(input_h Input : DataSet->InputStorageStructure.Units[0].Handles)
+		{
+			size_t Offset = OffsetForHandle(DataSet->InputStorageStructure, Input);
+			RunState.CurInputs[Input.Handle] = RunState.AllCurInputsBase[Offset];
+		}
+	}
+}
+
+inline void
+EndModelTimestep(mobius_data_set *DataSet, model_run_state &RunState)
+{
+	AccumulateStreamingObjectives(DataSet, RunState);
+	
+	RunState.AllLastResultsBase = RunState.AllCurResultsBase;
+	if(DataSet->ResultDataTimesteps < DataSet->TimestepsLastRun)
+	{
+		for(size_t Idx = 0; Idx < DataSet->KeptResultOffsets.size(); ++Idx)
+			DataSet->KeptResultData[Idx*DataSet->TimestepsLastRun + RunState.Timestep] = RunState.AllCurResultsBase[DataSet->KeptResultOffsets[Idx]];
+		
+		if(DataSet->ResultDataFloat)
+		{
+			float *HistoryRow = DataSet->ResultDataFloat + RunState.Timestep*DataSet->ResultStorageStructure.TotalCount;
+			for(size_t Offset = 0; Offset < DataSet->ResultStorageStructure.TotalCount; ++Offset)
+				HistoryRow[Offset] = (float)RunState.AllCurResultsBase[Offset];
+		}
 		
-		RunState.AllLastResultsBase = RunState.AllCurResultsBase;
+		RunState.AllCurResultsBase = DataSet->ResultData + (1 + (RunState.Timestep + 1) % DataSet->ResultDataTimesteps)*DataSet->ResultStorageStructure.TotalCount;
+	}
+	else
 		RunState.AllCurResultsBase += DataSet->ResultStorageStructure.TotalCount;
-		RunState.AllCurInputsBase  += DataSet->InputStorageStructure.TotalCount;
-		
-		RunState.CurrentTime.Advance();
+	RunState.AllCurInputsBase  += DataSet->InputStorageStructure.TotalCount;
+	
+	RunState.CurrentTime.Advance();
+	++RunState.Timestep;
+}
+
+static void
+RunModelTimestep(mobius_data_set *DataSet)
+{
+	mobius_run_context *Context = DataSet->RunContext;
+	model_run_state &RunState = Context->RunState;
+	
+	BeginModelTimestep(DataSet, RunState);
+	
+#if MOBIUS_PARALLEL_INSTANCES
+	ParallelModelLoop(DataSet, &RunState, &Context->ParallelSetup);
+#else
+	RunExecutionPlan(DataSet, &RunState, Context->ExecutionPlan);
+#endif
+	
+	EndModelTimestep(DataSet, RunState);
+}
+
+static void
+EndModelRun(mobius_data_set *DataSet)
+{
+	mobius_run_context *Context = DataSet->RunContext;
+	if(Context->RunState.Profile)
+	{
+		Context->RunState.Profile->RunCycles       = __rdtsc() - Context->RunBeginCycles;
+		Context->RunState.Profile->RunMilliseconds = GetTimerMilliseconds(&Context->RunTimer);
 	}
 	
+	if(DataSet->IncrementalRuns && !DataSet->RunWasStopped)   //NOTE: The results of a stopped run are not complete, so the next run can not reuse them.
+		SaveIncrementalRunState(DataSet);
+	
+#if MOBIUS_PARALLEL_INSTANCES
+	FreeParallelInstances(&Context->RunState, &Context->ParallelSetup);
+#endif
+	
+	DataSet->EarlierResultStepBack = Max(DataSet->EarlierResultStepBack, Context->RunState.MaxStepBack);
+
+#if MOBIUS_EQUATION_PROFILING
+	PrintRunProfile(DataSet);
+#endif
+}
+
+static void
+RunModel(mobius_data_set *DataSet)
+{
+#if MOBIUS_PRINT_TIMING_INFO
+	timer SetupTimer = BeginTimer();
+#endif
+	
+	BeginModelRun(DataSet);
+	
+#if MOBIUS_PRINT_TIMING_INFO
+	u64 SetupDuration = GetTimerMilliseconds(&SetupTimer);
+	timer RunTimer = BeginTimer();
+	u64 BeforeC = __rdtsc();
+#endif
+	
+	u64 Timesteps = DataSet->TimestepsLastRun;
+	for(u64 Timestep = (u64)DataSet->RunContext->RunState.Timestep; Timestep < Timesteps && !DataSet->RunWasStopped; ++Timestep)
+		RunModelTimestep(DataSet);
+	
 #if MOBIUS_PRINT_TIMING_INFO
 	u64 AfterC = __rdtsc();
 	
@@ -2055,11 +3106,80 @@ RunModel(mobius_data_set *DataSet)
 	std::cout << "(Note: one instance can be the result of several equation evaluations in the case of solvers)" << std::endl;
 #endif
 
-#if MOBIUS_EQUATION_PROFILING
-	PrintEquationProfiles(DataSet, &RunState);
+	EndModelRun(DataSet);
+	
+	if(DataSet->RunContext->RunState.MaxStepBack > 0)
+	{
+		//NOTE: An EARLIER_RESULT read further back than the result window (see GetEarlierResult), so the results of this run are wrong. Run it again with every timestep stored. The lookback is remembered in DataSet->EarlierResultStepBack, so the window of the next runs is large enough.
+		BeginModelRun(DataSet, true);
+		for(u64 Timestep = (u64)DataSet->RunContext->RunState.Timestep; Timestep < Timesteps && !DataSet->RunWasStopped; ++Timestep)
+			RunModelTimestep(DataSet);
+		EndModelRun(DataSet);
+	}
+}
+
+//NOTE: Run several data sets of the same model at the same time, each one on its own thread. This is meant for batches of scenarios or calibration runs, where the data sets are typically copies of one data set (made with CopyDataSet) with different parameter or input values. The results of each data set are stored in that data set, just as if RunModel had been called on it.
+//It is safe to run any number of data sets of the same finalized model concurrently, both with this function and from threads of your own, as long as each data set is only used by one thread at a time. The model is only read during a run, every data set has its own run state, result storage and random generator, and input data that is shared between copies is never written to during a run. Changing the inputs of a data set, or freeing it, is also safe while other data sets that share its input data are running, since the data is then copied or kept alive (see UnshareInputData).
+//The data sets are handed out to ThreadCount threads (or as many threads as OpenMP would use by default if ThreadCount is 0), one at a time. The program has to be compiled with OpenMP (-fopenmp) for this to run in parallel, otherwise the data sets are run one after another. If a run fails with an error that is thrown (as it is in the dll build), the other data sets are still run, and the error of the first data set that failed is thrown again once all the runs are done. This needs exceptions to be enabled, without them a failed run ends the program as in RunModel.
+static void
+RunModelsParallel(mobius_data_set * const *DataSets, size_t Count, int ThreadCount = 0)
+{
+	if(Count == 0) return;
+	
+	for(size_t Idx = 0; Idx < Count; ++Idx)
+	{
+		if(!DataSets[Idx])
+			FatalError("ERROR: Got an empty data set in RunModelsParallel.\n");
+		if(DataSets[Idx]->Model != DataSets[0]->Model)
+			FatalError("ERROR: All the data sets in RunModelsParallel have to belong to the same model.\n");
+	}
+	std::vector<mobius_data_set *> Sorted(DataSets, DataSets + Count);
+	std::sort(Sorted.begin(), Sorted.end());
+	if(std::adjacent_find(Sorted.begin(), Sorted.end()) != Sorted.end())
+		FatalError("ERROR: The same data set was passed to RunModelsParallel more than once.\n");
+	if(!DataSets[0]->Model->Finalized)
+		FatalError("ERROR: Tried to run a model before EndModelDefinition was called for it.\n");
+	
+#if defined(__cpp_exceptions)
+	std::vector<std::exception_ptr> Errors(Count);
+#endif
+	
+#if defined(_OPENMP)
+	if(ThreadCount <= 0) ThreadCount = omp_get_max_threads();
+	ThreadCount = (int)Min((size_t)ThreadCount, Count);
+	#pragma omp parallel for schedule(dynamic, 1) num_threads(ThreadCount)
+#endif
+	for(s64 Idx = 0; Idx < (s64)Count; ++Idx)
+	{
+#if defined(__cpp_exceptions)
+		//NOTE: Exceptions are not allowed to leave an OpenMP parallel region, so they are stored and thrown again on the calling thread.
+		try
+		{
+			RunModel(DataSets[Idx]);
+		}
+		catch(...)
+		{
+			Errors[Idx] = std::current_exception();
+		}
+#else
+		RunModel(DataSets[Idx]); //NOTE: Without exceptions FatalError exits the program, so there is nothing to pass on.
+#endif
+	}
+	
+#if defined(__cpp_exceptions)
+	for(std::exception_ptr &Error : Errors)
+	{
+		if(Error) std::rethrow_exception(Error);
+	}
 #endif
 }
 
+static void
+RunModelsParallel(const std::vector<mobius_data_set *> &DataSets, int ThreadCount = 0)
+{
+	RunModelsParallel(DataSets.data(), DataSets.size(), ThreadCount);
+}
+
 static void
 PrintEquationDependencies(mobius_model *Model)
 {
@@ -2216,31 +3336,51 @@ PrintInputStorageStructure(mobius_data_set *DataSet)
 	std::cout << std::endl;
 }
 
+//NOTE: Prints the timing information collected during the last profiled run of the data set, see SetProfiling.
 static void
-PrintEquationProfiles(mobius_data_set *DataSet, model_run_state *RunState)
+PrintRunProfile(mobius_data_set *DataSet)
 {
-#if MOBIUS_EQUATION_PROFILING
 	const mobius_model *Model = DataSet->Model;
+	const run_profile &Profile = DataSet->Profile;
+	
+	if(Profile.EquationHits.empty())
+	{
+		std::cout << "No profiled run of this data set." << std::endl;
+		return;
+	}
+	
+	std::cout << std::endl << "**** Run profile ****" << std::endl;
+	std::cout << "Setup: " << Profile.SetupMilliseconds << " milliseconds (" << Profile.SetupCycles << " cycles)" << std::endl;
+	std::cout << "Run: " << Profile.RunMilliseconds << " milliseconds (" << Profile.RunCycles << " cycles) for " << Profile.Timesteps << " timesteps" << std::endl;
+	
 	std::cout << std::endl << "**** Equation profiles - Average cycles per evaluation (number of evaluations) ****" << std::endl;
-	//std::cout << "Number of batches: " << Model->ResultStructure.size() << std::endl;
 	u64 SumCc = 0;
 	u64 TotalHits = 0;
 	
+	size_t BatchGroupIdx = 0;
 	for(const equation_batch_group &BatchGroup : Model->BatchGroups)
 	{	
 		std::cout << std::endl;
 		if(BatchGroup.IndexSets.Count == 0) std::cout << "[]";
 		for(index_set_h IndexSet : BatchGroup.IndexSets)
 			std::cout << "[" << GetName(Model, IndexSet) << "]";
+		if(Profile.BatchGroupHits[BatchGroupIdx])
+			printf(" %.1lf cycles per run of the batch group (%llu)", (double)Profile.BatchGroupCycles[BatchGroupIdx] / (double)Profile.BatchGroupHits[BatchGroupIdx], (unsigned long long)Profile.BatchGroupHits[BatchGroupIdx]);
 		
 		for(size_t BatchIdx = BatchGroup.FirstBatch; BatchIdx <= BatchGroup.LastBatch; ++BatchIdx)
 		{
 			const equation_batch &Batch = Model->EquationBatches[BatchIdx];
 			std::cout << "\n\t-----";
-			if(IsValid(Batch.Solver)) std::cout << " Solver \"" << GetName(Model, Batch.Solver) << "\"";
+			if(IsValid(Batch.Solver))
+			{
+				std::cout << " Solver \"" << GetName(Model, Batch.Solver) << "\"";
+				u64 SolverHits = Profile.SolverHits[Batch.Solver.Handle];
+				if(SolverHits)
+					printf(" %.1lf cycles per call (%llu), %.1lf evaluations per call", (double)Profile.SolverCycles[Batch.Solver.Handle] / (double)SolverHits, (unsigned long long)SolverHits, (double)Profile.SolverEvaluations[Batch.Solver.Handle] / (double)SolverHits);
+			}
 			
 			ForAllBatchEquations(Batch,
-			[Model, RunState, &TotalHits, &SumCc](equation_h Equation)
+			[Model, &Profile, &TotalHits, &SumCc](equation_h Equation)
 			{
 				int PrintCount = 0;
 				printf("\n\t");
@@ -2248,23 +3388,22 @@ PrintEquationProfiles(mobius_data_set *DataSet, model_run_state *RunState)
 				else if(Model->Equations[Equation].Type == EquationType_ODE) PrintCount += printf("(ODE) ");
 				PrintCount += printf("%s: ", GetName(Model, Equation));
 				
-				u64 Cc = RunState->EquationTotalCycles[Equation.Handle];
-				size_t Hits = RunState->EquationHits[Equation.Handle];
+				u64 Cc = Profile.EquationCycles[Equation.Handle];
+				u64 Hits = Profile.EquationHits[Equation.Handle];
 				double CcPerHit = (double)Cc / (double)Hits;
 				
 				char FormatString[100];
 				sprintf(FormatString, "%s%dlf", "%", 60-PrintCount);
-				//printf("%s", FormatString);
 				printf(FormatString, CcPerHit);
-				printf(" (%llu)", Hits);
+				printf(" (%llu)", (unsigned long long)Hits);
 				
-				TotalHits += (u64)Hits;
+				TotalHits += Hits;
 				SumCc += Cc;
 				return false;
 			});
 			if(BatchIdx == BatchGroup.LastBatch) std::cout << "\n\t-----\n";
 		}
+		++BatchGroupIdx;
 	}
 	std::cout << "\nTotal average cycles per evaluation: " << ((double)SumCc / (double)TotalHits)<< std::endl;
-#endif
 }
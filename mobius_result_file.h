@@ -0,0 +1,190 @@
+#if !defined(MOBIUS_RESULT_FILE_H)
+
+//NOTE: Memory mapped result storage.
+//
+//If a result file is set with SetResultFile, ResultData is not allocated with malloc, but lives in a file that is mapped into memory. The operating system can then page results out to the file instead of the process running out of memory, and the results stay in the file after the process exits, so other tools can read them directly without an export step.
+//
+//Layout of a result file. All numbers are stored in the byte order of the machine that wrote the file (little endian on all platforms we support).
+//
+//	result_file_header (64 bytes, see below).
+//	Description: DescriptionSize bytes of UTF-8 text starting at DescriptionOffset, see ResultFileDescription.
+//	Zero padding up to DataOffset, which is a multiple of 4096.
+//	Result values: (Timesteps + 1) rows of ValuesPerTimestep doubles. The first row holds the initial values, and row T+1 holds the values of timestep T.
+//
+//The description has one entry per line, and the fields of each entry are separated by tabs:
+//
+//	model      <model name>
+//	timestep   <"second" or "month">  <magnitude>
+//	index_set  <index set name>  <index name>  <index name> ...         (one line per index set)
+//	unit       <offset>  <equation count>  <index set name> ...          (one line per storage unit)
+//	equation   <equation name>                                           (one line for each of the equations of the unit above)
+//
+//The offset of the value of an equation within a row is
+//	unit offset + ((I0*C1 + I1)*C2 + I2 ...)*(equation count of the unit) + (position of the equation within the unit),
+//where I0, I1, ... are the positions of the indexes in the index sets of the unit (in the order they are listed on the unit line), and C1, C2, ... are the index counts of those index sets.
+//
+//The values of equations that were turned off by conditional execution are 0. The header is written again at the start of every run, so the file describes the latest run.
+
+struct result_file_header
+{
+	char Magic[8];              //NOTE: "MOBIUSRF"
+	u32  Version;               //NOTE: 1
+	u32  ValueSize;             //NOTE: sizeof(double)
+	u64  DescriptionOffset;     //NOTE: sizeof(result_file_header)
+	u64  DescriptionSize;
+	u64  DataOffset;
+	u64  Timesteps;             //NOTE: Not counting the row of initial values.
+	u64  ValuesPerTimestep;     //NOTE: ResultStorageStructure.TotalCount.
+	s64  StartDate;             //NOTE: The date of timestep 0 as seconds since 1970-01-01 00:00:00.
+};
+
+static_assert(sizeof(result_file_header) == 64, "The size of the result file header is part of the file format and should not change.");
+
+struct result_file_mapping
+{
+	std::string Description;
+	u8     *Base = nullptr;
+	size_t  Size = 0;
+#if defined(_WIN32)
+	HANDLE File    = INVALID_HANDLE_VALUE;
+	HANDLE Mapping = nullptr;
+#else
+	int File = -1;
+#endif
+};
+
+static std::string
+ResultFileDescription(mobius_data_set *DataSet)
+{
+	const mobius_model *Model = DataSet->Model;
+	storage_structure<equation_h> &Structure = DataSet->ResultStorageStructure;
+	
+	std::stringstream Out;
+	Out << "model\t" << Model->Name << "\n";
+	Out << "timestep\t" << (Model->TimestepSize.Unit == Timestep_Second ? "second" : "month") << "\t" << Model->TimestepSize.Magnitude << "\n";
+	
+	for(index_set_h IndexSet : Model->IndexSets)
+	{
+		Out << "index_set\t" << GetName(Model, IndexSet);
+		for(index_t Index = {IndexSet, 0}; Index < DataSet->IndexCounts[IndexSet.Handle]; ++Index)
+			Out << "\t" << DataSet->IndexNames[IndexSet.Handle][Index];
+		Out << "\n";
+	}
+	
+	for(size_t UnitIndex = 0; UnitIndex < Structure.Units.Count; ++UnitIndex)
+	{
+		storage_unit_specifier<equation_h> &Unit = Structure.Units[UnitIndex];
+		Out << "unit\t" << Structure.OffsetForUnit[UnitIndex] << "\t" << Unit.Handles.Count;
+		for(index_set_h IndexSet : Unit.IndexSets)
+			Out << "\t" << GetName(Model, IndexSet);
+		Out << "\n";
+		for(equation_h Equation : Unit.Handles)
+			Out << "equation\t" << GetName(Model, Equation) << "\n";
+	}
+	
+	return Out.str();
+}
+
+static void
+MapResultFile(mobius_data_set *DataSet, u64 Timesteps)
+{
+	const char *Filename = DataSet->ResultFilename.data();
+	
+	result_file_mapping *Mapping = new result_file_mapping();
+	Mapping->Description = ResultFileDescription(DataSet);
+	
+	u64 DataOffset = sizeof(result_file_header) + Mapping->Description.size();
+	DataOffset = ((DataOffset + 4095) / 4096) * 4096;   //NOTE: Page align the result data.
+	Mapping->Size = (size_t)(DataOffset + sizeof(double)*DataSet->ResultStorageStructure.TotalCount*(Timesteps + 1));
+	
+	//NOTE: The file is created or truncated, so that it is filled with zeros when it is extended to the right size.
+#if defined(_WIN32)
+	std::u16string Filename16 = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(Filename);
+	Mapping->File = CreateFileW((wchar_t *)Filename16.data(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(Mapping->File == INVALID_HANDLE_VALUE)
+		FatalError("ERROR: Tried to create the result file \"", Filename, "\", but was not able to.\n");
+	
+	LARGE_INTEGER FileSize;
+	FileSize.QuadPart = (LONGLONG)Mapping->Size;
+	if(!SetFilePointerEx(Mapping->File, FileSize, nullptr, FILE_BEGIN) || !SetEndOfFile(Mapping->File))
+		FatalError("ERROR: Was not able to extend the result file \"", Filename, "\" to ", Mapping->Size, " bytes.\n");
+	
+	Mapping->Mapping = CreateFileMappingW(Mapping->File, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+	if(Mapping->Mapping)
+		Mapping->Base = (u8 *)MapViewOfFile(Mapping->Mapping, FILE_MAP_ALL_ACCESS, 0, 0, Mapping->Size);
+	if(!Mapping->Base)
+		FatalError("ERROR: Was not able to map the result file \"", Filename, "\" into memory.\n");
+#else
+	Mapping->File = open(Filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(Mapping->File < 0)
+		FatalError("ERROR: Tried to create the result file \"", Filename, "\", but was not able to.\n");
+	
+	if(ftruncate(Mapping->File, (off_t)Mapping->Size) != 0)
+		FatalError("ERROR: Was not able to extend the result file \"", Filename, "\" to ", Mapping->Size, " bytes.\n");
+	
+	void *Base = mmap(nullptr, Mapping->Size, PROT_READ | PROT_WRITE, MAP_SHARED, Mapping->File, 0);
+	if(Base == MAP_FAILED)
+		FatalError("ERROR: Was not able to map the result file \"", Filename, "\" into memory.\n");
+	Mapping->Base = (u8 *)Base;
+#endif
+	
+	DataSet->ResultFile = Mapping;
+	DataSet->ResultData = (double *)(Mapping->Base + DataOffset);
+}
+
+static void
+WriteResultFileHeader(mobius_data_set *DataSet, u64 Timesteps)
+{
+	result_file_mapping *Mapping = DataSet->ResultFile;
+	
+	result_file_header *Header = (result_file_header *)Mapping->Base;
+	memcpy(Header->Magic, "MOBIUSRF", 8);
+	Header->Version           = 1;
+	Header->ValueSize         = sizeof(double);
+	Header->DescriptionOffset = sizeof(result_file_header);
+	Header->DescriptionSize   = Mapping->Description.size();
+	Header->DataOffset        = (u64)((u8 *)DataSet->ResultData - Mapping->Base);
+	Header->Timesteps         = Timesteps;
+	Header->ValuesPerTimestep = DataSet->ResultStorageStructure.TotalCount;
+	Header->StartDate         = GetStartDate(DataSet).SecondsSinceEpoch;
+	
+	memcpy(Mapping->Base + Header->DescriptionOffset, Mapping->Description.data(), Mapping->Description.size());
+}
+
+static void
+UnmapResultFile(mobius_data_set *DataSet)
+{
+	result_file_mapping *Mapping = DataSet->ResultFile;
+	if(!Mapping) return;
+	
+	//NOTE: The operating system writes the mapped pages back to the file, so we don't have to flush it explicitly.
+#if defined(_WIN32)
+	if(Mapping->Base) UnmapViewOfFile(Mapping->Base);
+	if(Mapping->Mapping) CloseHandle(Mapping->Mapping);
+	if(Mapping->File != INVALID_HANDLE_VALUE) CloseHandle(Mapping->File);
+#else
+	if(Mapping->Base) munmap(Mapping->Base, Mapping->Size);
+	if(Mapping->File >= 0) close(Mapping->File);
+#endif
+	
+	delete Mapping;
+	DataSet->ResultFile = nullptr;
+	DataSet->ResultData = nullptr;
+}
+
+//NOTE: Store the results of the following runs of this data set in the file Filename instead of in memory (see the top of this file for the file format). The file is overwritten by the next run. Give an empty Filename to go back to storing the results in memory.
+//This can not be combined with SetResultWindow, KeepResultSeries or SetSinglePrecisionResults.
+static void
+SetResultFile(mobius_data_set *DataSet, const char *Filename)
+{
+	if(!Filename) Filename = "";
+	if(DataSet->ResultFilename == Filename) return;
+	
+	//NOTE: The results of the last run are left in the old file (or discarded if they were in memory), and the result storage is set up again on the next run.
+	FreeResultData(DataSet);
+	DataSet->HasBeenRun = false;
+	DataSet->ResultFilename = Filename;
+}
+
+#define MOBIUS_RESULT_FILE_H
+#endif
@@ -47,5 +47,12 @@ GetTimerMilliseconds(timer *Timer)
 	return (u64)Ms;
 }
 
+inline u64
+GetTimerNanoseconds(timer *Timer)
+{
+	auto End = std::chrono::high_resolution_clock::now();
+	return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(End - Timer->Begin).count();
+}
+
 #define MOBIUS_UTIL_H
 #endif
\ No newline at end of file